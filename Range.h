@@ -3,12 +3,13 @@
 namespace alihan {
 template <typename Iterator> class Range {
 public:
+  Range() = default;
   Range(Iterator beginIt, Iterator endIt) : mBeginIt(beginIt), mEndIt(endIt) {}
   auto begin() -> Iterator { return mBeginIt; }
   auto end() -> Iterator { return mEndIt; }
 
 private:
-  Iterator mBeginIt;
-  Iterator mEndIt;
+  Iterator mBeginIt{};
+  Iterator mEndIt{};
 };
 } // namespace alihan
\ No newline at end of file
@@ -12,11 +12,21 @@
 //===----------------------------------------------------------------------===//
 
 #include "RegAllocChaitinRegisters.h"
+#include "RegAllocChaitinSerialization.h"
+#include "RegAllocChaitinSolutionCache.h"
 #include "RegAllocChaitinSolvers.h"
 #include "RegAllocChaitinGraph.h"
+#include "RegAllocChaitinSweep.h"
 
 #include "AllocationOrder.h"
 #include "RegAllocBase.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/CodeGen/CalcSpillWeights.h"
 #include "llvm/CodeGen/LiveIntervals.h"
@@ -25,23 +35,149 @@
 #include "llvm/CodeGen/LiveStacks.h"
 #include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/Passes.h"
 #include "llvm/CodeGen/RegAllocRegistry.h"
 #include "llvm/CodeGen/Spiller.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/CodeGen/VirtRegMap.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <chrono>
 #include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
 #include <queue>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "regalloc"
 
+STATISTIC(NumPotentialSpills, "Number of potential spills in simplify");
+STATISTIC(NumOptimisticColored,
+          "Number of potential spills colored optimistically");
+STATISTIC(NumCoalescedMoves, "Number of copies coalesced");
+STATISTIC(NumRounds, "Number of coloring rounds");
+STATISTIC(NumRoundSpills, "Number of registers spilled between rounds");
+STATISTIC(NumFrozenMoves, "Number of copies not coalesced conservatively");
+STATISTIC(NumVirtRegs, "Number of virtual registers given to the solvers");
+STATISTIC(NumInterferences, "Number of interferences between them");
+STATISTIC(NumGroups, "Number of physical register groups");
+STATISTIC(NumSubproblems, "Number of independently colored subproblems");
+STATISTIC(NumSimplifySteps, "Number of nodes removed by simplify");
+STATISTIC(NumColored, "Number of registers assigned by coloring");
+STATISTIC(NumFallbackQueued, "Number of registers left to the fallback");
+STATISTIC(NumFallbackSpills, "Number of registers spilled by the fallback");
+STATISTIC(NumOverBudget, "Number of subproblems colored greedily for budget");
+STATISTIC(NumCacheHits, "Number of subproblems found in the solution cache");
+STATISTIC(NumCacheMisses, "Number of subproblems missing from the cache");
+STATISTIC(NumLinearScan, "Number of subproblems colored by linear scan");
+STATISTIC(NumLinearScanFailed,
+          "Number of linear scans that left a register uncolored");
+STATISTIC(NumSameValueOverlaps,
+          "Number of overlaps ignored because both sides hold the same value");
+STATISTIC(NumJoinedRegs,
+          "Number of registers joined with a same-valued one at commit");
+STATISTIC(NumCommitFailed,
+          "Number of colored registers left to the fallback at commit");
+STATISTIC(NumLoopSplits, "Number of registers split around loops");
+STATISTIC(NumRematerializable,
+          "Number of registers given to the solvers as rematerializable");
+
+static cl::opt<bool> ChaitinParallelSolve(
+    "chaitin-parallel-solve", cl::Hidden, cl::init(false),
+    cl::desc("Color independent register subproblems in parallel"));
+
+static cl::opt<unsigned> ChaitinMaxRounds(
+    "chaitin-max-rounds", cl::Hidden, cl::init(8),
+    cl::desc("Maximum number of color and spill rounds before the remaining "
+             "registers are left to the fallback allocator"));
+
+namespace {
+enum class ChaitinSolverKind { Greedy, Chaitin, Optimistic, Coalescing };
+enum class ChaitinSpillCostKind { Weight, Remat };
+} // end anonymous namespace
+
+static cl::opt<ChaitinSolverKind> ChaitinSolverOpt(
+    "chaitin-solver", cl::Hidden, cl::init(ChaitinSolverKind::Coalescing),
+    cl::desc("Graph coloring solver for the Chaitin register allocator"),
+    cl::values(clEnumValN(ChaitinSolverKind::Greedy, "greedy",
+                          "Color by decreasing spill weight"),
+               clEnumValN(ChaitinSolverKind::Chaitin, "chaitin",
+                          "Simplify and select"),
+               clEnumValN(ChaitinSolverKind::Optimistic, "optimistic",
+                          "Simplify and select, coloring spills optimistically"),
+               clEnumValN(ChaitinSolverKind::Coalescing, "coalescing",
+                          "Optimistic after conservative coalescing")));
+
+static cl::opt<ChaitinSpillCostKind> ChaitinSpillCostOpt(
+    "chaitin-spill-cost", cl::Hidden, cl::init(ChaitinSpillCostKind::Remat),
+    cl::desc("Cost by which simplify picks potential spills"),
+    cl::values(clEnumValN(ChaitinSpillCostKind::Weight, "weight",
+                          "Spill weight divided by degree"),
+               clEnumValN(ChaitinSpillCostKind::Remat, "remat",
+                          "Weight cost, lowered for rematerializable "
+                          "registers")));
+
+static cl::opt<double> ChaitinRematSpillCostScale(
+    "chaitin-remat-spill-cost-scale", cl::Hidden,
+    cl::init(alihan::DefaultRematSpillCostScale),
+    cl::desc("Factor on the spill cost of rematerializable registers with "
+             "-chaitin-spill-cost=remat"));
+
+// Budgets beyond which the greedy solver is used instead, to bound compile
+// time on huge machine generated functions.
+static cl::opt<unsigned> ChaitinMaxNodes(
+    "chaitin-max-nodes", cl::Hidden, cl::init(50000),
+    cl::desc("Color functions with more virtual registers greedily"));
+
+static cl::opt<unsigned> ChaitinMaxEdges(
+    "chaitin-max-edges", cl::Hidden, cl::init(2000000),
+    cl::desc("Color functions with more interferences greedily"));
+
+// Which subproblems run out of a time budget depends on the load of the
+// machine, so it is off by default to keep the output deterministic.
+static cl::opt<unsigned> ChaitinSolveTimeBudget(
+    "chaitin-solve-time-budget", cl::Hidden, cl::init(0),
+    cl::desc("Milliseconds of solving per function after which the remaining "
+             "subproblems are colored greedily (0 = unlimited)"));
+
+static cl::opt<unsigned> ChaitinSolutionCacheSize(
+    "chaitin-solution-cache-size", cl::Hidden, cl::init(4096),
+    cl::desc("Maximum number of subproblem solutions remembered across the "
+             "functions of a module (0 = no cache)"));
+
+static cl::opt<bool> ChaitinLinearScan(
+    "chaitin-linear-scan", cl::Hidden, cl::init(true),
+    cl::desc("Color subproblems with no more registers live at once than "
+             "there are colors by linear scan, without a graph"));
+
+static cl::opt<bool> ChaitinValueInterference(
+    "chaitin-value-interference", cl::Hidden, cl::init(true),
+    cl::desc("Only let registers interfere where they may hold different "
+             "values, so that copies do not create interferences"));
+
+static cl::opt<bool> ChaitinSplitLoops(
+    "chaitin-split-loops", cl::Hidden, cl::init(true),
+    cl::desc("Split registers live through hot loops without uses in them "
+             "around the loops before coloring"));
+
+static cl::opt<std::string> ChaitinDumpDir(
+    "chaitin-dump-dir", cl::Hidden,
+    cl::desc("Write the allocation problem of every function and coloring "
+             "round to a binary dump in this directory"));
+
 namespace {
 struct CompSpillWeight {
   bool operator()(const LiveInterval *A, const LiveInterval *B) const {
@@ -70,8 +206,39 @@ class RAChaitin : public MachineFunctionPass,
   // selectOrSplit().
   BitVector UsableRegs;
 
+  // Backs RegsData, so that all of it is freed at once in releaseMemory.
+  std::pmr::monotonic_buffer_resource Arena;
+
+  // The coloring problem of the current function. It is kept across coloring
+  // rounds: registers the LiveRangeEdit callbacks report as changed are
+  // collected in DirtyRegs and only those are refreshed before the next round.
+  std::optional<alihan::Registers> RegsData;
+  SetVector<Register> DirtyRegs;
+  unsigned NumSeenVirtRegs = 0;
+  // Registers that overlap only where they hold the same value have no
+  // interference in RegsData, but a change to one may still make them
+  // interfere, so they are remembered here.
+  DenseMap<Register, SmallVector<Register, 4>> SameValueRegs;
+  DenseMap<const TargetRegisterClass *, BitVector> ClassRegs;
+  BitVector KnownPhys;
+
+  // Scratch space for collectCandidates.
+  enum class UnitState : char { Unknown, Free, Busy };
+  std::vector<UnitState> UnitStates;
+  SmallVector<unsigned, 32> QueriedUnits;
+  BitVector Candidates;
+  std::pmr::vector<unsigned> Units;
+  std::pmr::vector<unsigned> CandidatePhys;
+
+  // Time spent in the solvers on the current function.
+  std::chrono::steady_clock::duration SolveTime;
+
+  // Solutions of the subproblems of earlier functions in the module.
+  alihan::SolutionCache Solutions;
+
   bool LRE_CanEraseVirtReg(Register) override;
   void LRE_WillShrinkVirtReg(Register) override;
+  void LRE_DidCloneVirtReg(Register, Register) override;
 
 public:
   RAChaitin(const RegClassFilterFunc F = allocateAllRegClasses);
@@ -84,9 +251,14 @@ public:
 
   void releaseMemory() override;
 
+  bool doFinalization(Module &M) override;
+
   Spiller &spiller() override { return *SpillerInstance; }
 
-  void enqueueImpl(const LiveInterval *LI) override { Queue.push(LI); }
+  void enqueueImpl(const LiveInterval *LI) override {
+    ++NumFallbackQueued;
+    Queue.push(LI);
+  }
 
   const LiveInterval *dequeue() override {
     if (Queue.empty())
@@ -121,15 +293,42 @@ public:
   static char ID;
 
 private:
-  unsigned assignRemainingIntervals(
-      std::function<alihan::SolutionMap(const alihan::InterferenceGraph &, std::size_t)>
-          solver);
+  using ChaitinSolver =
+      std::function<alihan::SolutionMap(const alihan::InterferenceGraph &,
+                                        std::size_t, alihan::SolverStats &)>;
+
+  static ChaitinSolver getSolver(ChaitinSolverKind Kind);
+
+  // A value number of a virtual register.
+  using ValueId = std::pair<Register, unsigned>;
+
+  void addPhysReg(MCRegister PhysReg);
+  const BitVector &getClassRegs(const TargetRegisterClass *RC);
+  void collectCandidates(const LiveInterval &VirtReg);
+  bool isWorthSplittingAround(const MachineLoop &L) const;
+  void splitAroundLoop(Register Reg, const MachineLoop &L,
+                       SmallVectorImpl<Register> &OutsideRegs);
+  void splitAroundLoops();
+  ValueId getOriginalValue(const LiveInterval &VirtReg,
+                           const VNInfo *VNI) const;
+  bool holdSameValues(const LiveInterval &VirtReg1,
+                      const LiveInterval &VirtReg2) const;
+  void updateRegsData();
+  void dumpRegsData(unsigned Round);
+  std::optional<alihan::SolutionMap>
+  colorByLinearScan(const alihan::Registers &Subproblem) const;
+  alihan::SolutionMapLLVM
+  colorRemainingIntervals(ChaitinSolverKind Kind,
+                          SmallVectorImpl<Register> &Uncolored);
+  bool commitAssignment(Register Reg, MCRegister PhysReg);
+  unsigned assignRemainingIntervals(ChaitinSolverKind Kind);
 };
 
 char RAChaitin::ID = 0;
 } // end anonymous namespace
 
 bool RAChaitin::LRE_CanEraseVirtReg(Register VirtReg) {
+  DirtyRegs.insert(VirtReg);
   LiveInterval &LI = LIS->getInterval(VirtReg);
   if (VRM->hasPhys(VirtReg)) {
     Matrix->unassign(LI);
@@ -145,6 +344,7 @@ bool RAChaitin::LRE_CanEraseVirtReg(Register VirtReg) {
 }
 
 void RAChaitin::LRE_WillShrinkVirtReg(Register VirtReg) {
+  DirtyRegs.insert(VirtReg);
   if (!VRM->hasPhys(VirtReg))
     return;
 
@@ -154,6 +354,11 @@ void RAChaitin::LRE_WillShrinkVirtReg(Register VirtReg) {
   enqueue(&LI);
 }
 
+void RAChaitin::LRE_DidCloneVirtReg(Register New, Register Old) {
+  DirtyRegs.insert(New);
+  DirtyRegs.insert(Old);
+}
+
 RAChaitin::RAChaitin(RegClassFilterFunc F)
     : MachineFunctionPass(ID), RegAllocBase(F) {}
 
@@ -179,7 +384,22 @@ void RAChaitin::getAnalysisUsage(AnalysisUsage &AU) const {
   MachineFunctionPass::getAnalysisUsage(AU);
 }
 
-void RAChaitin::releaseMemory() { SpillerInstance.reset(); }
+void RAChaitin::releaseMemory() {
+  SpillerInstance.reset();
+  // RegsData lives in Arena, so it has to go first.
+  RegsData.reset();
+  Arena.release();
+  DirtyRegs.clear();
+  NumSeenVirtRegs = 0;
+  SameValueRegs.clear();
+  ClassRegs.clear();
+  KnownPhys.clear();
+}
+
+bool RAChaitin::doFinalization(Module &M) {
+  Solutions.clear();
+  return MachineFunctionPass::doFinalization(M);
+}
 
 // Spill or split all live virtual registers currently unified under PhysReg
 // that interfere with VirtReg. The newly spilled or split live intervals are
@@ -219,6 +439,7 @@ bool RAChaitin::spillInterferences(const LiveInterval &VirtReg,
     // Spill the extracted interval.
     LiveRangeEdit LRE(&Spill, SplitVRegs, *MF, *LIS, VRM, this, &DeadRemats);
     spiller().spill(LRE);
+    ++NumFallbackSpills;
   }
   return true;
 }
@@ -279,78 +500,855 @@ MCRegister RAChaitin::selectOrSplit(const LiveInterval &VirtReg,
     return ~0u;
   LiveRangeEdit LRE(&VirtReg, SplitVRegs, *MF, *LIS, VRM, this, &DeadRemats);
   spiller().spill(LRE);
+  ++NumFallbackSpills;
 
   // The live virtual register requesting allocation was spilled, so tell
   // the caller not to allocate anything during this round.
   return 0;
 }
 
-unsigned RAChaitin::assignRemainingIntervals(
-    std::function<alihan::SolutionMap(const alihan::InterferenceGraph &, std::size_t)>
-        Solver) {
-  std::vector<const LiveInterval *> Intervals;
-  for (unsigned I{0u}, E = MRI->getNumVirtRegs(); I != E; ++I) {
-    Register Reg = Register::index2VirtReg(I);
-    if (MRI->reg_nodbg_empty(Reg) || VRM->hasPhys(Reg)) {
+void RAChaitin::addPhysReg(MCRegister PhysReg) {
+  if (KnownPhys.test(PhysReg)) {
+    return;
+  }
+  KnownPhys.set(PhysReg);
+  Units.clear();
+  for (MCRegUnit Unit : TRI->regunits(PhysReg)) {
+    Units.push_back(Unit);
+  }
+  RegsData->addPhys(PhysReg, Units);
+}
+
+// Every physical register is registered with RegsData once, and the
+// allocatable registers of each register class are kept as a bitmask that all
+// virtual registers of that class start from.
+const BitVector &RAChaitin::getClassRegs(const TargetRegisterClass *RC) {
+  auto [It, Inserted] = ClassRegs.try_emplace(RC);
+  if (Inserted) {
+    It->second.resize(TRI->getNumRegs());
+    for (MCPhysReg PhysReg : RegClassInfo.getOrder(RC)) {
+      It->second.set(PhysReg);
+      addPhysReg(PhysReg);
+    }
+  }
+  return It->second;
+}
+
+// Register units are queried once per virtual register. A unit is busy if the
+// virtual register overlaps its fixed live range or anything already assigned
+// to it. Overlap is checked without the copy exemption that
+// LiveRegMatrix::checkInterference applies for a particular physical register,
+// so a free unit is free for every register containing it and only registers
+// with a busy unit need the exact check. The candidates are left in
+// CandidatePhys.
+void RAChaitin::collectCandidates(const LiveInterval &VirtReg) {
+  const BitVector &ClassMask = getClassRegs(MRI->getRegClass(VirtReg.reg()));
+  Candidates = ClassMask;
+  if (LIS->checkRegMaskInterference(VirtReg, UsableRegs)) {
+    Candidates &= UsableRegs;
+  }
+  for (unsigned Unit : QueriedUnits) {
+    UnitStates[Unit] = UnitState::Unknown;
+  }
+  QueriedUnits.clear();
+
+  auto IsUnitFree = [&](unsigned Unit) {
+    if (UnitStates[Unit] == UnitState::Unknown) {
+      bool Busy = VirtReg.overlaps(LIS->getRegUnit(Unit)) ||
+                  Matrix->query(VirtReg, Unit).checkInterference();
+      UnitStates[Unit] = Busy ? UnitState::Busy : UnitState::Free;
+      QueriedUnits.push_back(Unit);
+    }
+    return UnitStates[Unit] == UnitState::Free;
+  };
+
+  auto IsFree = [&](MCRegister PhysReg) {
+    if (!ClassMask.test(PhysReg)) {
+      // A hint from outside the class order, nothing is known about it.
+      return Matrix->checkInterference(VirtReg, PhysReg) ==
+             LiveRegMatrix::IK_Free;
+    }
+    if (!Candidates.test(PhysReg)) {
+      return false;
+    }
+    for (MCRegUnit Unit : TRI->regunits(PhysReg)) {
+      if (!IsUnitFree(Unit)) {
+        return Matrix->checkInterference(VirtReg, PhysReg) ==
+               LiveRegMatrix::IK_Free;
+      }
+    }
+    return true;
+  };
+
+  auto Order =
+      AllocationOrder::create(VirtReg.reg(), *VRM, RegClassInfo, Matrix);
+  CandidatePhys.clear();
+  for (MCRegister PhysReg : Order) {
+    assert(PhysReg.isValid());
+    addPhysReg(PhysReg);
+    if (IsFree(PhysReg)) {
+      CandidatePhys.push_back(PhysReg);
+    }
+  }
+}
+
+// A loop is worth splitting around if its header runs more often than its
+// preheader and exits together, so that copies and spill code placed there
+// are colder than anything in the loop. Every edge into and out of the loop
+// needs a block of its own to take them.
+bool RAChaitin::isWorthSplittingAround(const MachineLoop &L) const {
+  const MachineBasicBlock *Header = L.getHeader();
+  const MachineBasicBlock *Preheader = L.getLoopPreheader();
+  if (!Preheader || Header->isEHPad()) {
+    return false;
+  }
+  auto &MBFI = getAnalysis<MachineBlockFrequencyInfo>();
+  BlockFrequency BoundaryFreq = MBFI.getBlockFreq(Preheader);
+  SmallVector<MachineBasicBlock *, 4> Exits;
+  L.getUniqueExitBlocks(Exits);
+  for (const MachineBasicBlock *Exit : Exits) {
+    if (Exit->isEHPad() ||
+        any_of(Exit->predecessors(), [&](const MachineBasicBlock *Pred) {
+          return !L.contains(Pred);
+        })) {
+      return false;
+    }
+    BoundaryFreq += MBFI.getBlockFreq(Exit);
+  }
+  return BoundaryFreq < MBFI.getBlockFreq(Header);
+}
+
+// Reg is live into the header of L and neither used nor defined in it. A new
+// register takes over the value through the loop: it is copied from Reg at the
+// end of the preheader, and Reg is copied back at the top of every exit it is
+// live into. Reg is then dead in the loop.
+//
+// The spiller expects the interval of an original register to cover all the
+// registers split from it, as SplitKit leaves it, so an original register
+// keeps its interval and hands its operands over to another new register
+// first. Outside the loop the value may end up in several disconnected pieces,
+// which become registers of their own. The registers holding the value outside
+// the loop are appended to OutsideRegs.
+void RAChaitin::splitAroundLoop(Register Reg, const MachineLoop &L,
+                                SmallVectorImpl<Register> &OutsideRegs) {
+  LiveInterval &LI = LIS->getInterval(Reg);
+  SmallVector<MachineBasicBlock *, 4> Exits;
+  L.getUniqueExitBlocks(Exits);
+  erase_if(Exits, [&](const MachineBasicBlock *Exit) {
+    return !LIS->isLiveInToMBB(LI, Exit);
+  });
+
+  SmallVector<Register, 2> NewRegs;
+  LiveRangeEdit LRE(&LI, NewRegs, *MF, *LIS, VRM, this);
+  if (VRM->getOriginal(Reg) == Reg) {
+    Register OutsideReg = LRE.createFrom(Reg);
+    MRI->replaceRegWith(Reg, OutsideReg);
+    Reg = OutsideReg;
+  }
+  Register NewReg = LRE.createFrom(Reg);
+  const TargetInstrInfo *TII = MF->getSubtarget().getInstrInfo();
+  MachineBasicBlock *Preheader = L.getLoopPreheader();
+  LIS->InsertMachineInstrInMaps(
+      *BuildMI(*Preheader, Preheader->getFirstTerminator(), DebugLoc(),
+               TII->get(TargetOpcode::COPY), NewReg)
+           .addReg(Reg));
+  for (MachineBasicBlock *Exit : Exits) {
+    LIS->InsertMachineInstrInMaps(
+        *BuildMI(*Exit, Exit->SkipPHIsLabelsAndDebug(Exit->begin()),
+                 DebugLoc(), TII->get(TargetOpcode::COPY), Reg)
+             .addReg(NewReg));
+  }
+  for (MachineOperand &MO : make_early_inc_range(MRI->reg_operands(Reg))) {
+    if (MO.getParent()->isDebugInstr() &&
+        L.contains(MO.getParent()->getParent())) {
+      MO.setReg(NewReg);
+    }
+  }
+
+  // createFrom only computes intervals for unspillable registers.
+  for (Register SplitReg : {Reg, NewReg}) {
+    if (LIS->hasInterval(SplitReg)) {
+      LIS->removeInterval(SplitReg);
+    }
+    LIS->createAndComputeVirtRegInterval(SplitReg);
+  }
+  SmallVector<LiveInterval *, 4> Components;
+  LIS->splitSeparateComponents(LIS->getInterval(Reg), Components);
+  OutsideRegs.push_back(Reg);
+  for (const LiveInterval *Component : Components) {
+    VRM->setIsSplitFromReg(Component->reg(), VRM->getOriginal(Reg));
+    OutsideRegs.push_back(Component->reg());
+  }
+  ++NumLoopSplits;
+  LLVM_DEBUG(dbgs() << "Split " << printReg(Reg, TRI) << " around loop "
+                    << printMBBReference(*L.getHeader()) << " into "
+                    << printReg(NewReg, TRI) << '\n');
+}
+
+// A register that is live through a loop without uses in it would otherwise
+// either keep a color through the whole loop or be spilled with reloads inside
+// it, next to its uses elsewhere. Split around the loop, the piece through the
+// loop is colored on its own, and if it gets no color, its spill and reloads
+// land in the preheader and exits. Registers are split around the outermost
+// loops they are not used in that pass isWorthSplittingAround. This runs
+// before spill weights are computed, so the pieces get weights of their own.
+void RAChaitin::splitAroundLoops() {
+  auto &Loops = getAnalysis<MachineLoopInfo>();
+  if (Loops.empty()) {
+    return;
+  }
+  NamedRegionTimer T("chaitin-split", "Split Around Loops", TimerGroupName,
+                     TimerGroupDescription, TimePassesIsEnabled);
+  SmallPtrSet<const MachineLoop *, 16> SplitLoops;
+  SmallVector<const MachineLoop *, 16> Worklist(Loops.begin(), Loops.end());
+  while (!Worklist.empty()) {
+    const MachineLoop *L = Worklist.pop_back_val();
+    if (isWorthSplittingAround(*L)) {
+      SplitLoops.insert(L);
+    }
+    Worklist.append(L->begin(), L->end());
+  }
+  if (SplitLoops.empty()) {
+    return;
+  }
+
+  // The pieces outside a loop are looked at again for the other loops. The
+  // piece through the loop has no uses anywhere in it and is left alone.
+  SmallPtrSet<const MachineLoop *, 16> UsedLoops;
+  SmallVector<Register, 4> Pending;
+  for (unsigned I{0}, E = MRI->getNumVirtRegs(); I != E; ++I) {
+    Pending.assign(1, Register::index2VirtReg(I));
+    while (!Pending.empty()) {
+      Register Reg = Pending.pop_back_val();
+      if (MRI->reg_nodbg_empty(Reg) || !LIS->hasInterval(Reg) ||
+          LIS->getInterval(Reg).hasSubRanges() ||
+          !ShouldAllocateClass(*TRI, *MRI->getRegClass(Reg))) {
+        continue;
+      }
+      UsedLoops.clear();
+      for (const MachineInstr &MI : MRI->reg_nodbg_instructions(Reg)) {
+        const MachineLoop *L = Loops.getLoopFor(MI.getParent());
+        while (L && UsedLoops.insert(L).second) {
+          L = L->getParentLoop();
+        }
+      }
+      Worklist.assign(Loops.begin(), Loops.end());
+      while (!Worklist.empty()) {
+        const MachineLoop *L = Worklist.pop_back_val();
+        if (!UsedLoops.count(L) && SplitLoops.count(L) &&
+            LIS->isLiveInToMBB(LIS->getInterval(Reg), L->getHeader())) {
+          splitAroundLoop(Reg, *L, Pending);
+          break;
+        }
+        Worklist.append(L->begin(), L->end());
+      }
+    }
+  }
+}
+
+// Full copies between virtual registers pass a value on unchanged, so the value
+// VNI of VirtReg is the value the first register in a chain of such copies was
+// defined with. Chains are followed up to a fixed length; values defined by
+// anything else, including PHIs, are their own origin.
+RAChaitin::ValueId RAChaitin::getOriginalValue(const LiveInterval &VirtReg,
+                                               const VNInfo *VNI) const {
+  constexpr unsigned MaxCopyChain = 16;
+  Register Reg = VirtReg.reg();
+  for (unsigned Depth{0}; Depth != MaxCopyChain && !VNI->isPHIDef(); ++Depth) {
+    const MachineInstr *MI = LIS->getInstructionFromIndex(VNI->def);
+    if (!MI || !MI->isFullCopy()) {
+      break;
+    }
+    Register Src = MI->getOperand(1).getReg();
+    if (!Src.isVirtual() || !LIS->hasInterval(Src)) {
+      break;
+    }
+    const VNInfo *SrcVNI = LIS->getInterval(Src).Query(VNI->def).valueIn();
+    if (!SrcVNI) {
+      break;
+    }
+    Reg = Src;
+    VNI = SrcVNI;
+  }
+  return {Reg, VNI->id};
+}
+
+// Whether the two registers hold the same value wherever they overlap, so
+// that they can share a physical register.
+bool RAChaitin::holdSameValues(const LiveInterval &VirtReg1,
+                               const LiveInterval &VirtReg2) const {
+  LiveInterval::const_iterator I = VirtReg1.begin(), IE = VirtReg1.end();
+  LiveInterval::const_iterator J = VirtReg2.begin(), JE = VirtReg2.end();
+  while (I != IE && J != JE) {
+    if (I->start < J->end && J->start < I->end &&
+        getOriginalValue(VirtReg1, I->valno) !=
+            getOriginalValue(VirtReg2, J->valno)) {
+      return false;
+    }
+    if (I->end < J->end) {
+      ++I;
+    } else {
+      ++J;
+    }
+  }
+  return true;
+}
+
+// Brings RegsData up to date with the registers changed since the last round.
+// Every changed interval lies within the old interval of some register in
+// DirtyRegs: the spiller only creates registers inside the range of the one it
+// spills, and shrinking or splitting a register only narrows it. So new
+// interferences can only be between a dirty register and either another dirty
+// register or a former neighbour of one, interfering or same-valued, and only
+// those are swept. On the first round every register is new and this builds
+// the whole problem.
+//
+// Two registers interfere where their live segments overlap, except where both
+// hold the same value, as the source and destination of a copy do while both
+// are live. Such registers may share a physical register; commitAssignment
+// joins them if the solver gives them one.
+void RAChaitin::updateRegsData() {
+  std::optional<NamedRegionTimer> CollectTimer;
+  CollectTimer.emplace("chaitin-collect", "Collect Intervals", TimerGroupName,
+                       TimerGroupDescription, TimePassesIsEnabled);
+
+  // Not every register the spiller creates is reported to the delegate, so
+  // anything created since the last update counts as changed too.
+  for (unsigned I{NumSeenVirtRegs}, E = MRI->getNumVirtRegs(); I != E; ++I) {
+    DirtyRegs.insert(Register::index2VirtReg(I));
+  }
+  NumSeenVirtRegs = MRI->getNumVirtRegs();
+
+  SetVector<Register> Affected;
+  for (Register Reg : DirtyRegs) {
+    const alihan::Registers::VirtualRegister *VirtReg =
+        RegsData->getVirtReg(Reg);
+    if (!VirtReg) {
       continue;
     }
-    Intervals.push_back(&LIS->getInterval(Reg));
+    for (unsigned Interference : VirtReg->interferences) {
+      Affected.insert(
+          RegsData->getVirtId(RegsData->getVirtOrdinalIdFirst() + Interference)
+              .value());
+    }
+    // Some of these may have been deleted since.
+    for (Register SameValueReg : SameValueRegs.lookup(Reg)) {
+      if (RegsData->getVirtReg(SameValueReg)) {
+        Affected.insert(SameValueReg);
+      }
+    }
+    SameValueRegs.erase(Reg);
+    RegsData->removeVirt(Reg);
   }
 
-  if (Intervals.empty()) {
-    return 0;
+  // Dirty registers that still need a register come first, followed by the
+  // unchanged neighbours they may interfere with. The lists built here are
+  // only needed until the end of the update.
+  std::pmr::monotonic_buffer_resource Scratch;
+  std::pmr::vector<const LiveInterval *> Intervals(&Scratch);
+  for (Register Reg : DirtyRegs) {
+    if (!MRI->reg_nodbg_empty(Reg) && LIS->hasInterval(Reg) &&
+        !VRM->hasPhys(Reg)) {
+      Intervals.push_back(&LIS->getInterval(Reg));
+    }
+  }
+  unsigned DirtyCount = Intervals.size();
+  for (Register Reg : Affected) {
+    if (!DirtyRegs.count(Reg)) {
+      Intervals.push_back(&LIS->getInterval(Reg));
+    }
   }
 
-  alihan::Registers RegsData;
-  for (const LiveInterval *VirtReg : Intervals) {
-    auto Order =
-        AllocationOrder::create(VirtReg->reg(), *VRM, RegClassInfo, Matrix);
+  for (unsigned I{0}; I != DirtyCount; ++I) {
+    const LiveInterval *VirtReg = Intervals[I];
     LLVM_DEBUG(dbgs() << *VirtReg << '\n');
+    collectCandidates(*VirtReg);
+    // The same test that halves the spill weight of the register, so the
+    // spiller is able to rematerialize every value of it.
+    bool Rematerializable = VirtRegAuxInfo::isRematerializable(
+        *VirtReg, *LIS, *VRM, *MF->getSubtarget().getInstrInfo());
+    NumRematerializable += Rematerializable;
+    RegsData->addVirt(VirtReg->reg(), CandidatePhys, VirtReg->weight(),
+                      VirtReg->isSpillable(), Rematerializable);
+  }
+  CollectTimer.reset();
+
+  NamedRegionTimer InterfereTimer("chaitin-interfere", "Build Interferences",
+                                  TimerGroupName, TimerGroupDescription,
+                                  TimePassesIsEnabled);
+  // Segments are owned by themselves, so that the sweep reports each pair of
+  // overlapping segments and their values can be compared.
+  struct SegmentInfo {
+    unsigned Interval;
+    ValueId Value;
+  };
+  std::pmr::vector<alihan::Segment<SlotIndex>> Segments(&Scratch);
+  std::pmr::vector<SegmentInfo> SegmentInfos(&Scratch);
+  for (unsigned I{0u}; I != Intervals.size(); ++I) {
+    for (const LiveRange::Segment &S : *Intervals[I]) {
+      Segments.push_back({S.start, S.end, unsigned(SegmentInfos.size())});
+      SegmentInfos.push_back(
+          {I, ChaitinValueInterference ? getOriginalValue(*Intervals[I], S.valno)
+                                       : ValueId()});
+    }
+  }
+  alihan::forEachOverlap(std::move(Segments), [&](unsigned S1, unsigned S2) {
+    const SegmentInfo &Info1 = SegmentInfos[S1];
+    const SegmentInfo &Info2 = SegmentInfos[S2];
+    unsigned I = Info1.Interval, J = Info2.Interval;
+    if (I == J || (I >= DirtyCount && J >= DirtyCount)) {
+      return;
+    }
+    if (ChaitinValueInterference && Info1.Value == Info2.Value) {
+      ++NumSameValueOverlaps;
+      Register Reg1 = Intervals[I]->reg(), Reg2 = Intervals[J]->reg();
+      if (!is_contained(SameValueRegs[Reg1], Reg2)) {
+        SameValueRegs[Reg1].push_back(Reg2);
+        SameValueRegs[Reg2].push_back(Reg1);
+      }
+      return;
+    }
+    RegsData->addVirtInterference(Intervals[I]->reg(), Intervals[J]->reg());
+  });
+
+  // Full copies between virtual registers become move edges, weighted like
+  // spill weights by how often their block runs. Copies of registers that are
+  // not part of the problem are ignored by addVirtMove.
+  auto &MBFI = getAnalysis<MachineBlockFrequencyInfo>();
+  SmallPtrSet<const MachineInstr *, 16> SeenCopies;
+  for (unsigned I{0}; I != DirtyCount; ++I) {
+    for (const MachineInstr &MI :
+         MRI->reg_nodbg_instructions(Intervals[I]->reg())) {
+      if (!MI.isFullCopy() || !SeenCopies.insert(&MI).second) {
+        continue;
+      }
+      Register Dst = MI.getOperand(0).getReg();
+      Register Src = MI.getOperand(1).getReg();
+      if (Dst.isVirtual() && Src.isVirtual()) {
+        RegsData->addVirtMove(
+            Dst, Src, MBFI.getBlockFreqRelativeToEntryBlock(MI.getParent()));
+      }
+    }
+  }
 
-    std::unordered_set<unsigned> CandidatePhys;
-    for (MCRegister PhysReg : Order) {
-      assert(PhysReg.isValid());
-      if (Matrix->checkInterference(*VirtReg, PhysReg) ==
-          LiveRegMatrix::IK_Free) {
-        CandidatePhys.insert(PhysReg);
+  DirtyRegs.clear();
+  RegsData->finalizeInterferences();
+}
+
+// Writes RegsData to a new file in ChaitinDumpDir, see
+// RegAllocChaitinSerialization.h for the format.
+void RAChaitin::dumpRegsData(unsigned Round) {
+  std::string Name;
+  for (char C : MF->getName()) {
+    Name += isAlnum(C) || C == '_' ? C : '_';
+  }
+  SmallString<128> Model(ChaitinDumpDir);
+  sys::path::append(Model, Name + "." + Twine(Round) + "-%%%%%%.chaitin");
+
+  int FD;
+  SmallString<128> Path;
+  if (std::error_code EC = sys::fs::createUniqueFile(Model, FD, Path)) {
+    errs() << "warning: could not create " << Model << ": " << EC.message()
+           << '\n';
+    return;
+  }
+  std::vector<char> Data = alihan::serializeRegisters(*RegsData);
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  OS.write(Data.data(), Data.size());
+}
+
+// Register pressure is the number of registers live at once, which a sweep over
+// the live segments finds in O(n log n). If it exceeds the number of colors the
+// subproblem cannot be colored. Otherwise the subproblem is colored by a linear
+// scan in order of the start of the live ranges. That fails at times, because
+// live ranges with holes do not form an interval graph and candidates may be
+// restricted, and then nothing is returned.
+std::optional<alihan::SolutionMap>
+RAChaitin::colorByLinearScan(const alihan::Registers &Subproblem) const {
+  std::pmr::monotonic_buffer_resource Scratch;
+  std::pmr::vector<alihan::Segment<SlotIndex>> Segments(&Scratch);
+  unsigned VirtOrdinalIdFirst = Subproblem.getVirtOrdinalIdFirst();
+  for (unsigned Virt{VirtOrdinalIdFirst}, E{Subproblem.getVirtOrdinalIdLast()};
+       Virt != E; ++Virt) {
+    const LiveInterval &VirtReg =
+        LIS->getInterval(Subproblem.getVirtId(Virt).value());
+    for (const LiveRange::Segment &S : VirtReg) {
+      Segments.push_back({S.start, S.end, Virt - VirtOrdinalIdFirst});
+    }
+  }
+  if (alihan::sortAndCountMaxOverlap(Segments) > Subproblem.getGroupCount()) {
+    return std::nullopt;
+  }
+
+  std::vector<unsigned> Order;
+  std::pmr::vector<char> IsOrdered(Subproblem.getVirtCount(), false, &Scratch);
+  for (const alihan::Segment<SlotIndex> &S : Segments) {
+    if (!IsOrdered[S.owner]) {
+      IsOrdered[S.owner] = true;
+      Order.push_back(S.owner);
+    }
+  }
+  alihan::SolutionMap Solution = alihan::solveInOrder(Subproblem, Order);
+  if (std::find(Solution.begin() + VirtOrdinalIdFirst, Solution.end(),
+                alihan::NoColor) != Solution.end()) {
+    ++NumLinearScanFailed;
+    return std::nullopt;
+  }
+  return Solution;
+}
+
+// Colors every virtual register in RegsData and returns the coloring without
+// committing it. Registers that did not get a color are appended to Uncolored.
+alihan::SolutionMapLLVM
+RAChaitin::colorRemainingIntervals(ChaitinSolverKind Kind,
+                                   SmallVectorImpl<Register> &Uncolored) {
+  if (RegsData->getVirtCount() == 0) {
+    return {};
+  }
+  NumVirtRegs += RegsData->getVirtCount();
+  NumGroups += RegsData->getGroupCount();
+  size_t InterferenceEntries = 0;
+  for (unsigned Virt{RegsData->getVirtOrdinalIdFirst()},
+       E{RegsData->getVirtOrdinalIdLast()};
+       Virt != E; ++Virt) {
+    InterferenceEntries +=
+        RegsData->getVirtRegByOrdinal(Virt)->interferences.size();
+  }
+  // Every interference is listed at both of its registers.
+  NumInterferences += InterferenceEntries / 2;
+
+  bool OverSizeBudget = RegsData->getVirtCount() > ChaitinMaxNodes ||
+                        InterferenceEntries / 2 > ChaitinMaxEdges;
+  if (OverSizeBudget) {
+    LLVM_DEBUG(dbgs() << "Over the size budget, coloring greedily\n");
+  }
+  auto SolveStart = std::chrono::steady_clock::now();
+  auto IsOverTimeBudget = [&] {
+    return ChaitinSolveTimeBudget != 0 &&
+           SolveTime + (std::chrono::steady_clock::now() - SolveStart) >
+               std::chrono::milliseconds(ChaitinSolveTimeBudget);
+  };
+
+  // Registers from disjoint register files never compete for a color, and
+  // neither do registers in different connected components of the
+  // interference graph, so each of those subproblems is colored on its own
+  // with a smaller graph and fewer colors. They only live for this round, in
+  // their own arena.
+  std::pmr::monotonic_buffer_resource SubproblemArena;
+  std::vector<alihan::Registers> Subproblems;
+  for (const alihan::Registers &Partition :
+       RegsData->partitionByGroups(&SubproblemArena)) {
+    std::vector<alihan::Registers> Components =
+        Partition.splitComponents(&SubproblemArena);
+    std::move(Components.begin(), Components.end(),
+              std::back_inserter(Subproblems));
+  }
+  LLVM_DEBUG(dbgs() << "Split into " << Subproblems.size() << " subproblems\n");
+  NumSubproblems += Subproblems.size();
+
+  std::vector<std::optional<alihan::SolutionMapLLVM>> SubproblemSolutions(
+      Subproblems.size());
+  std::vector<alihan::SolverStats> SubproblemStats(Subproblems.size());
+  // Timers are not thread safe, so parallel solves are only timed as a whole,
+  // under chaitin-solve.
+  bool TimeStages = TimePassesIsEnabled && !ChaitinParallelSolve;
+  auto SolveSubproblem = [&](size_t I) {
+    const alihan::Registers &Subproblem = Subproblems[I];
+    alihan::SolutionMap Solution;
+    bool IsTrivial = Subproblem.isTriviallyColorable();
+    std::optional<alihan::SolutionMap> Scanned;
+    if (!IsTrivial && ChaitinLinearScan) {
+      NamedRegionTimer T("chaitin-linear-scan", "Linear Scan", TimerGroupName,
+                         TimerGroupDescription, TimeStages);
+      Scanned = colorByLinearScan(Subproblem);
+    }
+    if (IsTrivial) {
+      NamedRegionTimer T("chaitin-solve", "Solve", TimerGroupName,
+                         TimerGroupDescription, TimeStages);
+      Solution = alihan::solveTrivially(Subproblem);
+    } else if (Scanned) {
+      ++NumLinearScan;
+      Solution = std::move(*Scanned);
+    } else {
+      bool OverBudget = OverSizeBudget || IsOverTimeBudget();
+      NumOverBudget += OverBudget;
+      ChaitinSolverKind SubproblemKind =
+          OverBudget ? ChaitinSolverKind::Greedy : Kind;
+
+      std::optional<alihan::SolutionCache::Key> Key;
+      std::optional<alihan::SolutionMap> Cached;
+      if (ChaitinSolutionCacheSize != 0) {
+        Key = alihan::SolutionCache::makeKey(
+            Subproblem, static_cast<unsigned>(SubproblemKind));
+        Cached = Solutions.lookup(*Key);
       }
+      if (Cached) {
+        ++NumCacheHits;
+        Solution = std::move(*Cached);
+      } else {
+        std::optional<NamedRegionTimer> GraphTimer;
+        GraphTimer.emplace("chaitin-graph", "Create Interference Graph",
+                           TimerGroupName, TimerGroupDescription, TimeStages);
+        // A monotonic resource is not thread safe, so every graph gets its
+        // own.
+        std::pmr::monotonic_buffer_resource GraphArena;
+        alihan::InterferenceGraph Graph =
+            Subproblem.createInterferenceGraph(&GraphArena);
+        GraphTimer.reset();
+        NamedRegionTimer T("chaitin-solve", "Solve", TimerGroupName,
+                           TimerGroupDescription, TimeStages);
+        Solution = getSolver(SubproblemKind)(
+            Graph, Subproblem.getGroupCount(), SubproblemStats[I]);
+        if (Key) {
+          ++NumCacheMisses;
+          Solutions.insert(std::move(*Key), Solution);
+        }
+      }
+    }
+    NamedRegionTimer T("chaitin-convert", "Convert Solution", TimerGroupName,
+                       TimerGroupDescription, TimeStages);
+    SubproblemSolutions[I] =
+        alihan::convertSolutionMapToSolutionMapLLVM(Subproblem, Solution);
+  };
+  if (ChaitinParallelSolve) {
+    NamedRegionTimer T("chaitin-solve", "Solve", TimerGroupName,
+                       TimerGroupDescription, TimePassesIsEnabled);
+    parallelFor(0, Subproblems.size(), SolveSubproblem);
+  } else {
+    for (size_t I{0}; I != Subproblems.size(); ++I) {
+      SolveSubproblem(I);
+    }
+  }
+  SolveTime += std::chrono::steady_clock::now() - SolveStart;
 
-      auto SubregsRange = TRI->subregs(PhysReg);
-      std::vector<unsigned> Subregs(SubregsRange.begin(), SubregsRange.end());
-      RegsData.addPhys(PhysReg, Subregs);
+  alihan::SolutionMapLLVM SolutionLLVM;
+  for (std::optional<alihan::SolutionMapLLVM> &SubproblemSolution :
+       SubproblemSolutions) {
+    if (!SubproblemSolution) {
+      LLVM_DEBUG(dbgs() << "Couldn't generate a solution for a subproblem\n");
+      continue;
     }
-    RegsData.addVirt(VirtReg->reg(), std::move(CandidatePhys),
-                     VirtReg->weight(), VirtReg->isSpillable());
+    SolutionLLVM.insert(SubproblemSolution->begin(), SubproblemSolution->end());
+  }
+  for (const alihan::SolverStats &Stats : SubproblemStats) {
+    NumPotentialSpills += Stats.potentialSpills;
+    NumOptimisticColored += Stats.optimisticColored;
+    NumCoalescedMoves += Stats.coalescedMoves;
+    NumFrozenMoves += Stats.frozenMoves;
+    NumSimplifySteps += Stats.simplifySteps;
   }
 
-  for (unsigned I{0u}; I != Intervals.size(); ++I) {
-    for (unsigned J{I + 1}; J != Intervals.size(); ++J) {
-      bool Interference{!Intervals[I]->empty() &&
-                        Intervals[I]->overlaps(*Intervals[J])};
-      if (Interference) {
-        RegsData.addVirtInterference(Intervals[I]->reg(), Intervals[J]->reg());
+  LLVM_DEBUG(dbgs() << "Generated solution has " << SolutionLLVM.size() << " assignments\n");
+
+  for (unsigned Virt{RegsData->getVirtOrdinalIdFirst()},
+       E{RegsData->getVirtOrdinalIdLast()};
+       Virt != E; ++Virt) {
+    unsigned VirtId{RegsData->getVirtId(Virt).value()};
+    if (!SolutionLLVM.count(VirtId)) {
+      Uncolored.push_back(VirtId);
+    }
+  }
+  return SolutionLLVM;
+}
+
+// Assigns PhysReg to Reg in the LiveRegMatrix. Registers that overlap only where
+// they hold the same value do not interfere, so the solvers may give both the
+// same physical register, which the matrix cannot represent. Reg is then joined
+// into the registers already assigned there: all of them are renamed to one,
+// the copies between them become identity copies and are erased, and the
+// merged interval is assigned instead. This is checked again against the live
+// intervals here, and if anything else is in the way, Reg is left to the
+// fallback and false is returned.
+//
+// The spiller expects the interval of an original register to cover all the
+// registers split from it, so only registers split from the same original, or
+// registers that are all their own originals, are joined.
+bool RAChaitin::commitAssignment(Register Reg, MCRegister PhysReg) {
+  LiveInterval &VirtReg = LIS->getInterval(Reg);
+  switch (Matrix->checkInterference(VirtReg, PhysReg)) {
+  case LiveRegMatrix::IK_Free:
+    Matrix->assign(VirtReg, PhysReg);
+    return true;
+  case LiveRegMatrix::IK_VirtReg:
+    break;
+  default:
+    return false;
+  }
+
+  SmallSetVector<Register, 4> Joined;
+  const TargetRegisterClass *RC = MRI->getRegClass(Reg);
+  for (MCRegUnit Unit : TRI->regunits(PhysReg)) {
+    LiveIntervalUnion::Query &Q = Matrix->query(VirtReg, Unit);
+    for (const LiveInterval *Intf : Q.interferingVRegs()) {
+      if (VRM->getPhys(Intf->reg()) != PhysReg ||
+          !holdSameValues(VirtReg, *Intf)) {
+        return false;
+      }
+      if (Joined.insert(Intf->reg())) {
+        RC = TRI->getCommonSubClass(RC, MRI->getRegClass(Intf->reg()));
       }
     }
   }
+  if (!RC || !RC->contains(PhysReg)) {
+    return false;
+  }
+  // Either all registers are split from the same original, which is not one
+  // of them and keeps its interval, or none of them is split from another.
+  Register Original = VRM->getOriginal(Reg);
+  auto IsSibling = [&](Register JoinedReg) {
+    return JoinedReg != Original && VRM->getOriginal(JoinedReg) == Original;
+  };
+  auto IsOriginal = [&](Register JoinedReg) {
+    return VRM->getOriginal(JoinedReg) == JoinedReg;
+  };
+  if (Original == Reg ? !all_of(Joined, IsOriginal)
+                      : !all_of(Joined, IsSibling)) {
+    return false;
+  }
 
-  alihan::InterferenceGraph Graph = RegsData.createInterferenceGraph();
-  alihan::SolutionMap Solution = Solver(Graph, RegsData.getGroupCount());
-  std::optional<alihan::SolutionMapLLVM> SolutionLLVM =
-      alihan::convertSolutionMapToSolutionMapLLVM(RegsData, Solution);
+  Register Dst = Joined.front();
+  Joined.insert(Reg);
+  for (Register JoinedReg : Joined) {
+    LiveInterval &LI = LIS->getInterval(JoinedReg);
+    if (JoinedReg != Reg) {
+      Matrix->unassign(LI);
+    }
+    LIS->removeInterval(JoinedReg);
+  }
+  MRI->setRegClass(Dst, RC);
+  for (Register JoinedReg : Joined) {
+    if (JoinedReg != Dst) {
+      MRI->replaceRegWith(JoinedReg, Dst);
+    }
+  }
+  for (MachineInstr &MI : make_early_inc_range(MRI->reg_instructions(Dst))) {
+    if (MI.isIdentityCopy()) {
+      LIS->RemoveMachineInstrFromMaps(MI);
+      MI.eraseFromParent();
+    }
+  }
+  LiveInterval &Merged = LIS->createAndComputeVirtRegInterval(Dst);
+  // A copy into one of the registers may now be overwritten by a copy of the
+  // same value into another before any use, which leaves a dead def apart from
+  // the rest. Such pieces become registers of their own in the same place. As
+  // in LiveRangeEdit::eliminateDeadDefs, they are only split from the original
+  // of Dst if that is another register, whose interval still covers them.
+  SmallVector<LiveInterval *, 2> Components;
+  LIS->splitSeparateComponents(Merged, Components);
+  VirtRegAuxInfo VRAI(*MF, *LIS, *VRM, getAnalysis<MachineLoopInfo>(),
+                      getAnalysis<MachineBlockFrequencyInfo>());
+  VRAI.calculateSpillWeightAndHint(Merged);
+  Matrix->assign(Merged, PhysReg);
+  VRM->grow();
+  for (LiveInterval *Component : Components) {
+    if (VRM->getOriginal(Dst) != Dst) {
+      VRM->setIsSplitFromReg(Component->reg(), VRM->getOriginal(Dst));
+    }
+    VRAI.calculateSpillWeightAndHint(*Component);
+    Matrix->assign(*Component, PhysReg);
+  }
+  NumJoinedRegs += Joined.size() - 1;
+  LLVM_DEBUG(dbgs() << "Joined " << printReg(Reg, TRI) << " into " << Merged
+                    << '\n');
+  return true;
+}
 
-  if (!SolutionLLVM) {
-    LLVM_DEBUG(dbgs() << "Couldn't generate a solution\n");
-    return 0;
+// Maps a -chaitin-solver kind and -chaitin-spill-cost to a solver.
+RAChaitin::ChaitinSolver RAChaitin::getSolver(ChaitinSolverKind Kind) {
+  alihan::SpillCost SpillCost =
+      ChaitinSpillCostOpt == ChaitinSpillCostKind::Weight
+          ? alihan::SpillCost(alihan::spillCostByWeight)
+          : alihan::makeRematSpillCost(ChaitinRematSpillCostScale);
+  switch (Kind) {
+  case ChaitinSolverKind::Greedy:
+    return alihan::solveGreedy;
+  case ChaitinSolverKind::Chaitin:
+    return [SpillCost](const alihan::InterferenceGraph &Graph,
+                       std::size_t NumberOfColors,
+                       alihan::SolverStats &Stats) {
+      return alihan::solveChaitin(Graph, NumberOfColors, SpillCost, Stats);
+    };
+  case ChaitinSolverKind::Optimistic:
+    return [SpillCost](const alihan::InterferenceGraph &Graph,
+                       std::size_t NumberOfColors,
+                       alihan::SolverStats &Stats) {
+      return alihan::solveOptimistic(Graph, NumberOfColors, SpillCost, Stats);
+    };
+  case ChaitinSolverKind::Coalescing:
+    return [SpillCost](const alihan::InterferenceGraph &Graph,
+                       std::size_t NumberOfColors,
+                       alihan::SolverStats &Stats) {
+      return alihan::solveCoalescing(Graph, NumberOfColors, SpillCost, Stats);
+    };
   }
+  llvm_unreachable("Unknown Chaitin solver");
+}
 
-  LLVM_DEBUG(dbgs() << "Generated solution has " << SolutionLLVM->size() << " assignments\n");
+// Chaitin's allocation loop: color, spill the spillable registers that did
+// not get a color, and color again with the new short intervals the spiller
+// left behind. Nothing is committed to the LiveRegMatrix until a round needs
+// no more spills or ChaitinMaxRounds is reached; whatever is still uncolored
+// then is left to allocatePhysRegs.
+unsigned RAChaitin::assignRemainingIntervals(ChaitinSolverKind Kind) {
+  RegsData.emplace(&Arena);
+  SolveTime = {};
+  Solutions.setCapacity(ChaitinSolutionCacheSize);
+  KnownPhys.resize(TRI->getNumRegs());
+  UnitStates.assign(TRI->getNumRegUnits(), UnitState::Unknown);
+  QueriedUnits.clear();
+
+  alihan::SolutionMapLLVM SolutionLLVM;
+  for (unsigned Round{0};; ++Round) {
+    SmallVector<Register, 16> Uncolored;
+    updateRegsData();
+    if (!ChaitinDumpDir.empty()) {
+      dumpRegsData(Round);
+    }
+    SolutionLLVM = colorRemainingIntervals(Kind, Uncolored);
+    ++NumRounds;
 
-  for (auto [VirtId, PhysId] : *SolutionLLVM) {
-    Matrix->assign(LIS->getInterval(VirtId), PhysId);
+    SmallVector<Register, 16> ToSpill;
+    for (Register Reg : Uncolored) {
+      if (LIS->getInterval(Reg).isSpillable()) {
+        ToSpill.push_back(Reg);
+      }
+    }
+    LLVM_DEBUG(dbgs() << "Round " << Round << ": " << SolutionLLVM.size()
+                      << " colored, " << Uncolored.size() << " uncolored, "
+                      << ToSpill.size() << " to spill\n");
+    if (ToSpill.empty() || Round + 1 >= ChaitinMaxRounds) {
+      break;
+    }
+
+    NamedRegionTimer T("chaitin-spill", "Spill Between Rounds", TimerGroupName,
+                       TimerGroupDescription, TimePassesIsEnabled);
+    for (Register Reg : ToSpill) {
+      // Spilling an earlier register may have deleted this one as dead.
+      if (MRI->reg_nodbg_empty(Reg) || !LIS->hasInterval(Reg)) {
+        continue;
+      }
+      SmallVector<Register, 4> NewVRegs;
+      LiveRangeEdit LRE(&LIS->getInterval(Reg), NewVRegs, *MF, *LIS, VRM, this,
+                        &DeadRemats);
+      spiller().spill(LRE);
+      DirtyRegs.insert(Reg);
+      DirtyRegs.insert(NewVRegs.begin(), NewVRegs.end());
+      ++NumRoundSpills;
+    }
   }
 
+  unsigned NumAssigned = 0;
+  for (auto [VirtId, PhysId] : SolutionLLVM) {
+    if (commitAssignment(VirtId, PhysId)) {
+      ++NumAssigned;
+    } else {
+      ++NumCommitFailed;
+    }
+  }
+  NumColored += NumAssigned;
+
   Matrix->invalidateVirtRegs();
-  return SolutionLLVM->size();
+  return NumAssigned;
 }
 
 bool RAChaitin::runOnMachineFunction(MachineFunction &mf) {
@@ -360,16 +1358,24 @@ bool RAChaitin::runOnMachineFunction(MachineFunction &mf) {
   MF = &mf;
   RegAllocBase::init(getAnalysis<VirtRegMap>(), getAnalysis<LiveIntervals>(),
                      getAnalysis<LiveRegMatrix>());
+  if (ChaitinSplitLoops) {
+    splitAroundLoops();
+  }
   VirtRegAuxInfo VRAI(*MF, *LIS, *VRM, getAnalysis<MachineLoopInfo>(),
                       getAnalysis<MachineBlockFrequencyInfo>());
   VRAI.calculateSpillWeightsAndHints();
 
   SpillerInstance.reset(createInlineSpiller(*this, *MF, *VRM, VRAI));
 
-  unsigned N = assignRemainingIntervals(alihan::solveChaitin);
+  unsigned N = assignRemainingIntervals(ChaitinSolverOpt);
   LLVM_DEBUG(dbgs() << "Assigned " << N << " intervals\n");
 
-  allocatePhysRegs();
+  {
+    NamedRegionTimer T("chaitin-fallback", "Fallback Allocation",
+                       TimerGroupName, TimerGroupDescription,
+                       TimePassesIsEnabled);
+    allocatePhysRegs();
+  }
   postOptimization();
 
   // Diagnostic output before rewriting
@@ -1,11 +1,18 @@
 #include "RegAllocChaitinGraph.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <memory_resource>
 #include <optional>
+#include <utility>
 
 namespace alihan {
-InterferenceGraph::Node::Node(double weight, bool spillable)
-    : mWeight{weight}, mSpillable{spillable} {}
+InterferenceGraph::Node::Node(double weight, bool spillable,
+                              bool rematerializable,
+                              std::pmr::memory_resource *resource)
+    : mWeight{weight}, mSpillable{spillable},
+      mRematerializable{rematerializable}, mEdges(resource), mMoves(resource) {}
 
 auto InterferenceGraph::Node::getWeight() const -> double { return mWeight; }
 
@@ -13,17 +20,62 @@ auto InterferenceGraph::Node::getSpillable() const -> bool {
   return mSpillable;
 }
 
+auto InterferenceGraph::Node::getRematerializable() const -> bool {
+  return mRematerializable;
+}
+
 auto InterferenceGraph::Node::getEdgeCount() const -> std::size_t {
   return mEdges.size();
 }
 
+// Edges are kept sorted, so that looking one up stays logarithmic in graphs
+// too large for the bit matrix.
 auto InterferenceGraph::Node::hasEdge(unsigned node) const -> bool {
-  return mEdges.count(node);
+  return std::binary_search(mEdges.begin(), mEdges.end(), node);
 }
 
-void InterferenceGraph::Node::addEdge(unsigned node) { mEdges.insert(node); }
+// Registers::createInterferenceGraph adds the edges of every node in
+// ascending order, which only appends.
+void InterferenceGraph::Node::addEdge(unsigned node) {
+  if (mEdges.empty() || mEdges.back() < node) {
+    mEdges.push_back(node);
+  } else {
+    mEdges.insert(std::lower_bound(mEdges.begin(), mEdges.end(), node), node);
+  }
+}
 
-void InterferenceGraph::Node::removeEdge(unsigned node) { mEdges.erase(node); }
+void InterferenceGraph::Node::removeEdge(unsigned node) {
+  auto it = std::lower_bound(mEdges.begin(), mEdges.end(), node);
+  if (it != mEdges.end() && *it == node) {
+    mEdges.erase(it);
+  }
+}
+
+// Repeated moves between the same nodes are merged into one with the summed
+// weight.
+void InterferenceGraph::Node::addMove(unsigned node, double weight) {
+  auto it = std::find_if(mMoves.begin(), mMoves.end(),
+                         [&](const Move &move) { return move.node == node; });
+  if (it == mMoves.end()) {
+    mMoves.push_back({node, weight});
+  } else {
+    it->weight += weight;
+  }
+}
+
+void InterferenceGraph::Node::removeMove(unsigned node) {
+  auto it = std::find_if(mMoves.begin(), mMoves.end(),
+                         [&](const Move &move) { return move.node == node; });
+  if (it != mMoves.end()) {
+    *it = mMoves.back();
+    mMoves.pop_back();
+  }
+}
+
+auto InterferenceGraph::Node::getMoves() const
+    -> const std::pmr::vector<Move> & {
+  return mMoves;
+}
 
 auto InterferenceGraph::Node::isLessThan(const Node &other) const -> bool {
   if (mSpillable && other.mSpillable) {
@@ -41,15 +93,20 @@ auto InterferenceGraph::Node::end() const -> EdgeIterator {
   return mEdges.end();
 }
 
-InterferenceGraph::NodeIterator::NodeIterator(iterator node) : mNode{node} {}
+InterferenceGraph::NodeIterator::NodeIterator(const container &nodes,
+                                              unsigned node)
+    : mNodes{&nodes}, mNode{node} {
+  skipAbsent();
+}
 
 auto InterferenceGraph::NodeIterator::operator++() -> NodeIterator & {
   ++mNode;
+  skipAbsent();
   return *this;
 }
 
 auto InterferenceGraph::NodeIterator::operator*() const -> unsigned {
-  return mNode->first;
+  return mNode;
 }
 
 auto InterferenceGraph::NodeIterator::operator==(const NodeIterator &it) const
@@ -62,9 +119,31 @@ auto InterferenceGraph::NodeIterator::operator!=(const NodeIterator &it) const
   return !(*this == it);
 }
 
-auto InterferenceGraph::isEmpty() const -> bool { return mGraph.empty(); }
+void InterferenceGraph::NodeIterator::skipAbsent() {
+  while (mNode < mNodes->size() && !(*mNodes)[mNode]) {
+    ++mNode;
+  }
+}
+
+InterferenceGraph::InterferenceGraph(std::size_t numberOfColors,
+                                     std::pmr::memory_resource *resource)
+    : mNodes(resource), mNumberOfColors{numberOfColors},
+      mColorWordCount{(numberOfColors + 63) / 64}, mForbiddenColors(resource),
+      mForbiddenColorCounts(resource), mMatrix(resource),
+      mColorAliases(resource) {}
+
+auto InterferenceGraph::getMemoryResource() const
+    -> std::pmr::memory_resource * {
+  return mNodes.get_allocator().resource();
+}
+
+auto InterferenceGraph::isEmpty() const -> bool { return mSize == 0; }
+
+auto InterferenceGraph::getSize() const -> std::size_t { return mSize; }
 
-auto InterferenceGraph::getSize() const -> std::size_t { return mGraph.size(); }
+auto InterferenceGraph::getNodeIdLast() const -> unsigned {
+  return mNodes.size();
+}
 
 auto InterferenceGraph::getWeight(unsigned node) const
     -> std::optional<double> {
@@ -82,6 +161,14 @@ auto InterferenceGraph::getSpillable(unsigned node) const
   return {};
 }
 
+auto InterferenceGraph::getRematerializable(unsigned node) const
+    -> std::optional<bool> {
+  if (const Node *n = getNode(node)) {
+    return n->getRematerializable();
+  }
+  return {};
+}
+
 auto InterferenceGraph::getEdgeCount(unsigned node) const
     -> std::optional<std::size_t> {
   if (const Node *n = getNode(node)) {
@@ -90,24 +177,76 @@ auto InterferenceGraph::getEdgeCount(unsigned node) const
   return {};
 }
 
+auto InterferenceGraph::getDegree(unsigned node) const
+    -> std::optional<std::size_t> {
+  const Node *n = getNode(node);
+  if (!n) {
+    return {};
+  }
+  if (!hasColorAliases()) {
+    return n->getEdgeCount() + mForbiddenColorCounts[node];
+  }
+  std::size_t degree{mForbiddenColorCounts[node]};
+  for (unsigned neighbour : *n) {
+    degree += getSqueeze(node, neighbour).value();
+  }
+  return degree;
+}
+
+auto InterferenceGraph::getNumberOfColors() const -> std::size_t {
+  return mNumberOfColors;
+}
+
+auto InterferenceGraph::getForbiddenColorCount(unsigned node) const
+    -> std::optional<std::size_t> {
+  if (getNode(node)) {
+    return mForbiddenColorCounts[node];
+  }
+  return {};
+}
+
 auto InterferenceGraph::hasNode(unsigned node) const -> bool {
-  return mGraph.count(node);
+  return getNode(node);
 }
 
 auto InterferenceGraph::hasEdge(unsigned node1, unsigned node2) const -> bool {
   const Node *n1 = getNode(node1);
-  return n1 && n1->hasEdge(node2);
+  const Node *n2 = getNode(node2);
+  if (!n1 || !n2 || node1 == node2) {
+    return false;
+  }
+
+  if (mHasMatrix) {
+    std::size_t bit{getMatrixBit(node1, node2)};
+    return (mMatrix[bit / 64] >> (bit % 64)) & 1;
+  }
+  return (n1->getEdgeCount() <= n2->getEdgeCount()) ? n1->hasEdge(node2)
+                                                    : n2->hasEdge(node1);
 }
 
-void InterferenceGraph::addNode(unsigned id, double weight, bool spillable) {
-  mGraph.insert({id, Node(weight, spillable)});
+void InterferenceGraph::addNode(unsigned id, double weight, bool spillable,
+                                bool rematerializable) {
+  reserveNode(id);
+  if (!mNodes[id]) {
+    mNodes[id].emplace(weight, spillable, rematerializable,
+                       getMemoryResource());
+    std::fill_n(mForbiddenColors.begin() + id * mColorWordCount,
+                mColorWordCount, 0);
+    mForbiddenColorCounts[id] = 0;
+    ++mSize;
+  }
 }
 
 auto InterferenceGraph::addEdge(unsigned node1, unsigned node2) -> bool {
   if (Node *n1 = getNode(node1)) {
     if (Node *n2 = getNode(node2)) {
-      n1->addEdge(node2);
-      n2->addEdge(node1);
+      if (node1 != node2 && !hasEdge(node1, node2)) {
+        n1->addEdge(node2);
+        n2->addEdge(node1);
+        if (mHasMatrix) {
+          setMatrixBit(node1, node2, true);
+        }
+      }
       return true;
     }
   }
@@ -119,22 +258,132 @@ void InterferenceGraph::removeNode(unsigned node) {
     for (unsigned edge : *n) {
       Node *e = getNode(edge);
       e->removeEdge(node);
+      if (mHasMatrix) {
+        setMatrixBit(node, edge, false);
+      }
     }
-    mGraph.erase(node);
+    for (const Move &move : n->getMoves()) {
+      getNode(move.node)->removeMove(node);
+    }
+    mNodes[node].reset();
+    --mSize;
   }
 }
 
 auto InterferenceGraph::removeEdge(unsigned node1, unsigned node2) -> bool {
   if (Node *n1 = getNode(node1)) {
     if (Node *n2 = getNode(node2)) {
-      n1->removeEdge(node2);
-      n2->removeEdge(node1);
+      if (hasEdge(node1, node2)) {
+        n1->removeEdge(node2);
+        n2->removeEdge(node1);
+        if (mHasMatrix) {
+          setMatrixBit(node1, node2, false);
+        }
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+auto InterferenceGraph::isColorForbidden(unsigned node, unsigned color) const
+    -> bool {
+  if (!getNode(node) || color >= mNumberOfColors) {
+    return false;
+  }
+  std::uint64_t word{mForbiddenColors[node * mColorWordCount + color / 64]};
+  return (word >> (color % 64)) & 1;
+}
+
+auto InterferenceGraph::forbidColor(unsigned node, unsigned color) -> bool {
+  if (!getNode(node) || color >= mNumberOfColors) {
+    return false;
+  }
+  if (!isColorForbidden(node, color)) {
+    mForbiddenColors[node * mColorWordCount + color / 64] |= std::uint64_t{1}
+                                                             << (color % 64);
+    ++mForbiddenColorCounts[node];
+  }
+  return true;
+}
+
+auto InterferenceGraph::addMove(unsigned node1, unsigned node2, double weight)
+    -> bool {
+  if (Node *n1 = getNode(node1)) {
+    if (Node *n2 = getNode(node2)) {
+      if (node1 != node2) {
+        n1->addMove(node2, weight);
+        n2->addMove(node1, weight);
+      }
       return true;
     }
   }
   return false;
 }
 
+auto InterferenceGraph::aliasColors(unsigned color1, unsigned color2)
+    -> bool {
+  if (color1 >= mNumberOfColors || color2 >= mNumberOfColors) {
+    return false;
+  }
+  if (mColorAliases.empty()) {
+    mColorAliases.resize(mNumberOfColors * mColorWordCount);
+    for (unsigned color{0}; color != mNumberOfColors; ++color) {
+      mColorAliases[color * mColorWordCount + color / 64] |= std::uint64_t{1}
+                                                             << (color % 64);
+    }
+  }
+  mColorAliases[color1 * mColorWordCount + color2 / 64] |= std::uint64_t{1}
+                                                           << (color2 % 64);
+  mColorAliases[color2 * mColorWordCount + color1 / 64] |= std::uint64_t{1}
+                                                           << (color1 % 64);
+  return true;
+}
+
+auto InterferenceGraph::hasColorAliases() const -> bool {
+  return !mColorAliases.empty();
+}
+
+auto InterferenceGraph::getSqueeze(unsigned node, unsigned neighbour) const
+    -> std::optional<std::size_t> {
+  if (!getNode(node) || !getNode(neighbour)) {
+    return {};
+  }
+  return getSqueeze(mForbiddenColors.data() + node * mColorWordCount,
+                    mForbiddenColors.data() + neighbour * mColorWordCount);
+}
+
+// Every color the neighbour may take is tried, counting the allowed colors of
+// the node among its aliases.
+auto InterferenceGraph::getSqueeze(
+    const std::uint64_t *forbidden,
+    const std::uint64_t *neighbourForbidden) const -> std::size_t {
+  if (!hasColorAliases()) {
+    return 1;
+  }
+  std::size_t squeeze{0};
+  for (std::size_t word{0}; word != mColorWordCount; ++word) {
+    std::uint64_t allowed{~neighbourForbidden[word]};
+    while (allowed) {
+      std::size_t color{word * 64 + __builtin_ctzll(allowed)};
+      allowed &= allowed - 1;
+      if (color >= mNumberOfColors) {
+        break;
+      }
+      const std::uint64_t *aliases =
+          mColorAliases.data() + color * mColorWordCount;
+      std::size_t taken{0};
+      for (std::size_t aliasWord{0}; aliasWord != mColorWordCount;
+           ++aliasWord) {
+        taken +=
+            __builtin_popcountll(aliases[aliasWord] & ~forbidden[aliasWord]);
+      }
+      squeeze = std::max(squeeze, taken);
+    }
+  }
+  return squeeze;
+}
+
 auto InterferenceGraph::isNodeLessThan(unsigned node1, unsigned node2) const
     -> std::optional<bool> {
   if (const Node *n1 = getNode(node1)) {
@@ -146,29 +395,53 @@ auto InterferenceGraph::isNodeLessThan(unsigned node1, unsigned node2) const
 }
 
 auto InterferenceGraph::getNodeRange() const -> Range<NodeIterator> {
-  return Range<NodeIterator>(mGraph.begin(), mGraph.end());
+  return Range<NodeIterator>(
+      NodeIterator(mNodes, 0),
+      NodeIterator(mNodes, static_cast<unsigned>(mNodes.size())));
 }
 
 auto InterferenceGraph::getEdgeRange(unsigned node) const
-    -> std::optional<Range<EdgeIterator>> {
-  if (const Node *n = getNode(node)) {
-    return Range<EdgeIterator>(n->begin(), n->end());
+    -> Range<EdgeIterator> {
+  const Node *n = getNode(node);
+  assert(n && "No such node");
+  return Range<EdgeIterator>(n->begin(), n->end());
+}
+
+auto InterferenceGraph::getForbiddenColorRange(unsigned node) const
+    -> Range<ColorWordIterator> {
+  assert(getNode(node) && "No such node");
+  auto first = mForbiddenColors.begin() + node * mColorWordCount;
+  return Range<ColorWordIterator>(first, first + mColorWordCount);
+}
+
+auto InterferenceGraph::getMoveRange(unsigned node) const
+    -> Range<MoveIterator> {
+  const Node *n = getNode(node);
+  assert(n && "No such node");
+  return Range<MoveIterator>(n->getMoves().begin(), n->getMoves().end());
+}
+
+auto InterferenceGraph::getColorAliasRange(unsigned color) const
+    -> std::optional<Range<ColorWordIterator>> {
+  if (!hasColorAliases() || color >= mNumberOfColors) {
+    return {};
   }
-  return {};
+  auto first = mColorAliases.begin() + color * mColorWordCount;
+  return Range<ColorWordIterator>(first, first + mColorWordCount);
 }
 
 auto InterferenceGraph::print(std::ostream &os) const -> std::ostream & {
   os << '[';
   bool firstNode{true};
-  for (auto const &node : mGraph) {
+  for (unsigned node : getNodeRange()) {
     if (!firstNode) {
       os << ", ";
     }
     firstNode = false;
-    os << node.first << ": {";
+    os << node << ": {";
 
     bool firstEdge{true};
-    for (unsigned edgeNode : node.second) {
+    for (unsigned edgeNode : *mNodes[node]) {
       if (!firstEdge) {
         os << ", ";
       }
@@ -183,12 +456,60 @@ auto InterferenceGraph::print(std::ostream &os) const -> std::ostream & {
 }
 
 auto InterferenceGraph::getNode(unsigned node) const -> const Node * {
-  auto it = mGraph.find(node);
-  return (it == mGraph.end()) ? nullptr : &it->second;
+  if (node >= mNodes.size() || !mNodes[node]) {
+    return nullptr;
+  }
+  return &*mNodes[node];
 }
 
 auto InterferenceGraph::getNode(unsigned node) -> Node * {
-  auto it = mGraph.find(node);
-  return (it == mGraph.end()) ? nullptr : &it->second;
+  if (node >= mNodes.size() || !mNodes[node]) {
+    return nullptr;
+  }
+  return &*mNodes[node];
+}
+
+auto InterferenceGraph::getMatrixBit(unsigned node1, unsigned node2) const
+    -> std::size_t {
+  if (node1 < node2) {
+    std::swap(node1, node2);
+  }
+  return static_cast<std::size_t>(node1) * (node1 - 1) / 2 + node2;
+}
+
+void InterferenceGraph::setMatrixBit(unsigned node1, unsigned node2,
+                                     bool value) {
+  std::size_t bit{getMatrixBit(node1, node2)};
+  std::uint64_t mask{std::uint64_t{1} << (bit % 64)};
+  if (value) {
+    mMatrix[bit / 64] |= mask;
+  } else {
+    mMatrix[bit / 64] &= ~mask;
+  }
+}
+
+void InterferenceGraph::reserveNode(unsigned node) {
+  if (node < mNodes.size()) {
+    return;
+  }
+
+  std::size_t nodeCount{static_cast<std::size_t>(node) + 1};
+  mNodes.resize(nodeCount);
+  mForbiddenColors.resize(nodeCount * mColorWordCount);
+  mForbiddenColorCounts.resize(nodeCount);
+  if (!mHasMatrix) {
+    return;
+  }
+
+  if (nodeCount > MaxMatrixNodes) {
+    mHasMatrix = false;
+    mMatrix.clear();
+    mMatrix.shrink_to_fit();
+    return;
+  }
+
+  // Rows only ever get appended, so growing keeps existing bits in place.
+  std::size_t bitCount{nodeCount * (nodeCount - 1) / 2};
+  mMatrix.resize((bitCount + 63) / 64);
 }
 } // namespace alihan
@@ -4,28 +4,51 @@
 
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <memory_resource>
 #include <optional>
 #include <ostream>
-#include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 namespace alihan {
+// Node ids are expected to be dense (see Registers::getVirtOrdinalId), so nodes
+// are stored in a vector indexed by id. Adjacency is kept both as per-node edge
+// lists for iteration and, while the graph is small enough, as a triangular bit
+// matrix for constant time edge queries.
+//
+// Precolored nodes are not part of the graph. Instead every node carries a set
+// of forbidden colors, and each forbidden color counts towards its degree like
+// an edge to a precolored neighbour would.
+//
+// Move edges connect nodes joined by copies. They are hints only: two nodes
+// with a move between them may still interfere.
 class InterferenceGraph {
+public:
+  struct Move {
+    unsigned node;
+    double weight;
+  };
+
 private:
   class Node {
   public:
-    using EdgeIterator = std::unordered_set<unsigned>::const_iterator;
+    using EdgeIterator = std::pmr::vector<unsigned>::const_iterator;
+    using MoveIterator = std::pmr::vector<Move>::const_iterator;
 
     Node() = delete;
-    Node(double weight, bool spillable);
+    Node(double weight, bool spillable, bool rematerializable, std::pmr::memory_resource *resource);
 
     [[nodiscard]] auto getWeight() const -> double;
     [[nodiscard]] auto getSpillable() const -> bool;
+    [[nodiscard]] auto getRematerializable() const -> bool;
     [[nodiscard]] auto getEdgeCount() const -> std::size_t;
 
     [[nodiscard]] auto hasEdge(unsigned node) const -> bool;
     void addEdge(unsigned node);
     void removeEdge(unsigned node);
+    void addMove(unsigned node, double weight);
+    void removeMove(unsigned node);
+    [[nodiscard]] auto getMoves() const -> const std::pmr::vector<Move> &;
 
     [[nodiscard]] auto isLessThan(const Node &node) const -> bool;
 
@@ -35,53 +58,109 @@ private:
   private:
     double mWeight;
     bool mSpillable;
-    std::unordered_set<unsigned> mEdges;
+    bool mRematerializable;
+    std::pmr::vector<unsigned> mEdges;
+    std::pmr::vector<Move> mMoves;
   };
 
 public:
   using EdgeIterator = Node::EdgeIterator;
+  using MoveIterator = Node::MoveIterator;
+  using ColorWordIterator = std::pmr::vector<std::uint64_t>::const_iterator;
 
   class NodeIterator {
   private:
-    using iterator = std::unordered_map<unsigned, Node>::const_iterator;
+    using container = std::pmr::vector<std::optional<Node>>;
 
   public:
     using value_type = unsigned;
 
-    NodeIterator(iterator node);
+    NodeIterator(const container &nodes, unsigned node);
     auto operator++() -> NodeIterator &;
     [[nodiscard]] auto operator*() const -> unsigned;
     [[nodiscard]] auto operator==(NodeIterator const &it) const -> bool;
     [[nodiscard]] auto operator!=(NodeIterator const &it) const -> bool;
 
   private:
-    iterator mNode;
+    void skipAbsent();
+
+    const container *mNodes;
+    unsigned mNode;
   };
 
+  InterferenceGraph() = default;
+  // All memory of the graph comes from resource.
+  explicit InterferenceGraph(
+      std::size_t numberOfColors,
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  [[nodiscard]] auto getMemoryResource() const -> std::pmr::memory_resource *;
+
   [[nodiscard]] auto isEmpty() const -> bool;
   [[nodiscard]] auto getSize() const -> std::size_t;
+  [[nodiscard]] auto getNodeIdLast() const -> unsigned;
   [[nodiscard]] auto getWeight(unsigned node) const -> std::optional<double>;
   [[nodiscard]] auto getSpillable(unsigned node) const -> std::optional<bool>;
+  [[nodiscard]] auto getRematerializable(unsigned node) const -> std::optional<bool>;
   [[nodiscard]] auto getEdgeCount(unsigned node) const -> std::optional<std::size_t>;
+  // Forbidden colors plus the squeeze of every neighbour, see getSqueeze.
+  [[nodiscard]] auto getDegree(unsigned node) const -> std::optional<std::size_t>;
+  [[nodiscard]] auto getNumberOfColors() const -> std::size_t;
+  [[nodiscard]] auto getForbiddenColorCount(unsigned node) const -> std::optional<std::size_t>;
 
   [[nodiscard]] auto hasNode(unsigned node) const -> bool;
   [[nodiscard]] auto hasEdge(unsigned node1, unsigned node2) const -> bool;
-  void addNode(unsigned id, double weight, bool spillable);
+  void addNode(unsigned id, double weight, bool spillable, bool rematerializable = false);
   auto addEdge(unsigned node1, unsigned node2) -> bool;
   void removeNode(unsigned node);
   auto removeEdge(unsigned node1, unsigned node2) -> bool;
+  [[nodiscard]] auto isColorForbidden(unsigned node, unsigned color) const -> bool;
+  auto forbidColor(unsigned node, unsigned color) -> bool;
+  auto addMove(unsigned node1, unsigned node2, double weight) -> bool;
+  // Colors alias when they share a register unit, so that neighbours may not
+  // take one each. Every color aliases itself.
+  auto aliasColors(unsigned color1, unsigned color2) -> bool;
+  [[nodiscard]] auto hasColorAliases() const -> bool;
+  // The number of colors allowed for a node that a single color allowed for a
+  // neighbour can take away, at most. Without aliased colors this is 1. The
+  // overload on raw bitsets takes getNumberOfColors() bits of forbidden colors
+  // of each node.
+  [[nodiscard]] auto getSqueeze(unsigned node, unsigned neighbour) const -> std::optional<std::size_t>;
+  [[nodiscard]] auto getSqueeze(const std::uint64_t *forbidden, const std::uint64_t *neighbourForbidden) const -> std::size_t;
 
   [[nodiscard]] auto isNodeLessThan(unsigned node1, unsigned node2) const -> std::optional<bool>;
 
   [[nodiscard]] auto getNodeRange() const -> Range<NodeIterator>;
-  [[nodiscard]] auto getEdgeRange(unsigned node) const -> std::optional<Range<EdgeIterator>>;
+  // node must be in the graph.
+  [[nodiscard]] auto getEdgeRange(unsigned node) const -> Range<EdgeIterator>;
+  [[nodiscard]] auto getForbiddenColorRange(unsigned node) const -> Range<ColorWordIterator>;
+  [[nodiscard]] auto getMoveRange(unsigned node) const -> Range<MoveIterator>;
+  // Returns nothing while no colors alias.
+  [[nodiscard]] auto getColorAliasRange(unsigned color) const -> std::optional<Range<ColorWordIterator>>;
 
   auto print(std::ostream &os) const -> std::ostream &;
 
 private:
+  // Above this many node ids the bit matrix would outgrow the edge lists, so
+  // edge queries fall back to a binary search of the shorter sorted list.
+  static constexpr std::size_t MaxMatrixNodes{1u << 14};
+
   [[nodiscard]] auto getNode(unsigned node) const -> const Node *;
   [[nodiscard]] auto getNode(unsigned node) -> Node *;
-
-  std::unordered_map<unsigned, Node> mGraph;
+  [[nodiscard]] auto getMatrixBit(unsigned node1, unsigned node2) const -> std::size_t;
+  void setMatrixBit(unsigned node1, unsigned node2, bool value);
+  void reserveNode(unsigned node);
+
+  std::pmr::vector<std::optional<Node>> mNodes;
+  std::size_t mSize{0};
+  std::size_t mNumberOfColors{0};
+  std::size_t mColorWordCount{0};
+  std::pmr::vector<std::uint64_t> mForbiddenColors;
+  std::pmr::vector<std::size_t> mForbiddenColorCounts;
+  bool mHasMatrix{true};
+  std::pmr::vector<std::uint64_t> mMatrix;
+  // Color bitset of the aliases of every color, empty until the first
+  // aliasColors.
+  std::pmr::vector<std::uint64_t> mColorAliases;
 };
 } // namespace alihan
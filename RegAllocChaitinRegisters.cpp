@@ -1,31 +1,220 @@
 #include "RegAllocChaitinRegisters.h"
 #include "RegAllocChaitinGraph.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <limits>
+#include <memory_resource>
 #include <optional>
 #include <ostream>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
+namespace {
+constexpr unsigned NoGroup{std::numeric_limits<unsigned>::max()};
+constexpr unsigned NoIndex{std::numeric_limits<unsigned>::max()};
+
+// Bit sets are vectors of 64 bit words, with any allocator.
+template <typename Words> auto testBit(const Words &bits, unsigned i) -> bool {
+  return i / 64 < bits.size() && ((bits[i / 64] >> (i % 64)) & 1);
+}
+
+template <typename Words> void setBit(Words &bits, unsigned i) {
+  if (i / 64 >= bits.size()) {
+    bits.resize(i / 64 + 1);
+  }
+  bits[i / 64] |= std::uint64_t{1} << (i % 64);
+}
+
+// Whether two sorted ranges have an element in common.
+template <typename Elements1, typename Elements2>
+auto sharesElement(const Elements1 &elements1, const Elements2 &elements2)
+    -> bool {
+  auto it1 = elements1.begin();
+  auto it2 = elements2.begin();
+  while (it1 != elements1.end() && it2 != elements2.end()) {
+    if (*it1 < *it2) {
+      ++it1;
+    } else if (*it2 < *it1) {
+      ++it2;
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Number of set bits below bit i.
+template <typename Words>
+auto rankBit(const Words &bits, unsigned i) -> unsigned {
+  unsigned rank{0};
+  for (unsigned word{0}; word != i / 64; ++word) {
+    rank += __builtin_popcountll(bits[word]);
+  }
+  if (std::uint64_t mask = (std::uint64_t{1} << (i % 64)) - 1) {
+    rank += __builtin_popcountll(bits[i / 64] & mask);
+  }
+  return rank;
+}
+
+class DisjointSets {
+public:
+  explicit DisjointSets(std::size_t size);
+  [[nodiscard]] auto find(unsigned element) -> unsigned;
+  void unite(unsigned element1, unsigned element2);
+
+private:
+  std::vector<unsigned> mParents;
+};
+
+DisjointSets::DisjointSets(std::size_t size) : mParents(size) {
+  for (unsigned i{0}; i != size; ++i) {
+    mParents[i] = i;
+  }
+}
+
+auto DisjointSets::find(unsigned element) -> unsigned {
+  while (mParents[element] != element) {
+    mParents[element] = mParents[mParents[element]];
+    element = mParents[element];
+  }
+  return element;
+}
+
+void DisjointSets::unite(unsigned element1, unsigned element2) {
+  unsigned root1{find(element1)};
+  unsigned root2{find(element2)};
+  if (root1 < root2) {
+    mParents[root2] = root1;
+  } else {
+    mParents[root1] = root2;
+  }
+}
+} // namespace
+
 namespace alihan {
+Registers::VirtualRegister::VirtualRegister(std::pmr::memory_resource *resource)
+    : interferences(resource), candidateGroups(resource),
+      candidatePhysRegs(resource), moves(resource) {}
+
+auto Registers::VirtualRegister::hasCandidateGroup(unsigned groupId) const
+    -> bool {
+  return testBit(candidateGroups, groupId);
+}
+
+auto Registers::VirtualRegister::getCandPhysInGroup(unsigned groupId) const
+    -> std::optional<unsigned> {
+  if (!hasCandidateGroup(groupId)) {
+    return {};
+  }
+  return candidatePhysRegs[rankBit(candidateGroups, groupId)];
+}
+
+Registers::Registers(std::pmr::memory_resource *resource)
+    : mVirtRegs(resource), mUnfinalized(resource),
+      mVirtToVirtOrdinal(resource), mVirtOrdinalToVirt(resource),
+      mPhysToGroupidx(resource), mGroups(resource), mGroupUnits(resource),
+      mGroupAliases(resource) {}
+
+auto Registers::getMemoryResource() const -> std::pmr::memory_resource * {
+  return mVirtRegs.get_allocator().resource();
+}
+
 void Registers::addVirt(unsigned id,
-                        std::unordered_set<unsigned> candidatePhysIds,
-                        double weight, bool spillable) {
-  VirtualRegister reg;
+                        const std::pmr::vector<unsigned> &candidatePhysIds,
+                        double weight, bool spillable,
+                        bool rematerializable) {
+  if (mVirtToVirtOrdinal.count(id)) {
+    return;
+  }
+
+  VirtualRegister reg(getMemoryResource());
   reg.weight = weight;
   reg.spillable = spillable;
-  reg.candidatePhysRegs = std::move(candidatePhysIds);
-  mVirtRegs.insert({id, std::move(reg)});
-  mVirtToVirtOrdinal[id] = mVirtOrdinalToVirt.size();
+  reg.rematerializable = rematerializable;
+  for (unsigned physId : candidatePhysIds) {
+    std::optional<unsigned> groupId = getPhysGroupId(physId);
+    if (groupId && !testBit(reg.candidateGroups, *groupId)) {
+      setBit(reg.candidateGroups, *groupId);
+      reg.candidatePhysRegs.push_back(physId);
+    }
+  }
+  // Every group occurs once, so this orders them by group alone.
+  std::sort(reg.candidatePhysRegs.begin(), reg.candidatePhysRegs.end(),
+            [&](unsigned physId1, unsigned physId2) {
+              return mPhysToGroupidx[physId1] < mPhysToGroupidx[physId2];
+            });
+
+  mVirtToVirtOrdinal.insert({id, static_cast<unsigned>(mVirtRegs.size())});
   mVirtOrdinalToVirt.push_back(id);
+  mVirtRegs.push_back(std::move(reg));
+  mUnfinalized.push_back(false);
+}
+
+auto Registers::removeVirt(unsigned id) -> bool {
+  auto it = mVirtToVirtOrdinal.find(id);
+  if (it == mVirtToVirtOrdinal.end()) {
+    return false;
+  }
+  unsigned i{it->second};
+  mVirtToVirtOrdinal.erase(it);
+
+  // Removing entries keeps sorted lists sorted.
+  for (unsigned interference : mVirtRegs[i].interferences) {
+    std::pmr::vector<unsigned> &interferences =
+        mVirtRegs[interference].interferences;
+    interferences.erase(
+        std::remove(interferences.begin(), interferences.end(), i),
+        interferences.end());
+  }
+  for (const Move &move : mVirtRegs[i].moves) {
+    std::pmr::vector<Move> &moves = mVirtRegs[move.virtIndex].moves;
+    moves.erase(std::remove_if(moves.begin(), moves.end(),
+                               [&](const Move &m) { return m.virtIndex == i; }),
+                moves.end());
+  }
+
+  // Renumbering the last register can reorder its neighbours' lists.
+  unsigned last{static_cast<unsigned>(mVirtRegs.size()) - 1};
+  if (i != last) {
+    for (unsigned interference : mVirtRegs[last].interferences) {
+      std::pmr::vector<unsigned> &interferences =
+          mVirtRegs[interference].interferences;
+      std::replace(interferences.begin(), interferences.end(), last, i);
+      mUnfinalized[interference] = true;
+    }
+    for (const Move &move : mVirtRegs[last].moves) {
+      for (Move &m : mVirtRegs[move.virtIndex].moves) {
+        if (m.virtIndex == last) {
+          m.virtIndex = i;
+        }
+      }
+      mUnfinalized[move.virtIndex] = true;
+    }
+    mVirtRegs[i] = std::move(mVirtRegs[last]);
+    mUnfinalized[i] = mUnfinalized[last];
+    mVirtOrdinalToVirt[i] = mVirtOrdinalToVirt[last];
+    mVirtToVirtOrdinal[mVirtOrdinalToVirt[i]] = i;
+  }
+  mVirtRegs.pop_back();
+  mUnfinalized.pop_back();
+  mVirtOrdinalToVirt.pop_back();
+  return true;
 }
 
 auto Registers::getVirtCount() const -> unsigned { return mVirtRegs.size(); }
 
 auto Registers::getVirtReg(unsigned virtId) const -> const VirtualRegister * {
-  auto it = mVirtRegs.find(virtId);
-  return (it == mVirtRegs.cend()) ? nullptr : &it->second;
+  auto it = mVirtToVirtOrdinal.find(virtId);
+  return (it == mVirtToVirtOrdinal.cend()) ? nullptr : &mVirtRegs[it->second];
+}
+
+auto Registers::getVirtRegByOrdinal(unsigned virtOrdinalId) const
+    -> const VirtualRegister * {
+  unsigned i{virtOrdinalId - getVirtOrdinalIdFirst()};
+  return (i >= mVirtRegs.size()) ? nullptr : &mVirtRegs[i];
 }
 
 auto Registers::getVirtOrdinalId(unsigned virtId) const
@@ -58,49 +247,122 @@ auto Registers::getVirtOrdinalIdLast() const -> unsigned {
   return getVirtOrdinalIdFirst() + getVirtCount();
 }
 
+// Interferences are only appended here, callers that may add the same pair
+// more than once have to call finalizeInterferences afterwards.
 auto Registers::addVirtInterference(unsigned virtId1,
                                     unsigned virtId2) -> bool {
-  auto itEnd = mVirtRegs.end();
-  if (auto it1 = mVirtRegs.find(virtId1); it1 != itEnd) {
-    if (auto it2 = mVirtRegs.find(virtId2); it2 != itEnd) {
-      it1->second.interferences.insert(virtId2);
-      it2->second.interferences.insert(virtId1);
+  auto itEnd = mVirtToVirtOrdinal.end();
+  if (auto it1 = mVirtToVirtOrdinal.find(virtId1); it1 != itEnd) {
+    if (auto it2 = mVirtToVirtOrdinal.find(virtId2); it2 != itEnd) {
+      if (it1 == it2) {
+        return false;
+      }
+      mVirtRegs[it1->second].interferences.push_back(it2->second);
+      mVirtRegs[it2->second].interferences.push_back(it1->second);
+      mUnfinalized[it1->second] = true;
+      mUnfinalized[it2->second] = true;
       return true;
     }
   }
   return false;
 }
 
-auto Registers::addPhys(unsigned id,
-                        const std::vector<unsigned> &subregIds) -> unsigned {
-  auto endIt = mPhysToGroupidx.end();
-  auto it = mPhysToGroupidx.find(id);
-  if (it != endIt) {
-    return it->second;
+auto Registers::addVirtMove(unsigned virtId1, unsigned virtId2, double weight)
+    -> bool {
+  auto itEnd = mVirtToVirtOrdinal.end();
+  if (auto it1 = mVirtToVirtOrdinal.find(virtId1); it1 != itEnd) {
+    if (auto it2 = mVirtToVirtOrdinal.find(virtId2); it2 != itEnd) {
+      if (it1 == it2) {
+        return false;
+      }
+      mVirtRegs[it1->second].moves.push_back({it2->second, weight});
+      mVirtRegs[it2->second].moves.push_back({it1->second, weight});
+      mUnfinalized[it1->second] = true;
+      mUnfinalized[it2->second] = true;
+      return true;
+    }
   }
+  return false;
+}
+
+// Also merges repeated moves and drops moves between interfering registers,
+// those can never end up in the same register. Only registers changed since
+// the last call are visited.
+void Registers::finalizeInterferences() {
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    if (!mUnfinalized[i]) {
+      continue;
+    }
+    mUnfinalized[i] = false;
+    VirtualRegister &virtReg = mVirtRegs[i];
+    std::pmr::vector<unsigned> &interferences = virtReg.interferences;
+    std::sort(interferences.begin(), interferences.end());
+    interferences.erase(std::unique(interferences.begin(), interferences.end()),
+                        interferences.end());
+
+    std::pmr::vector<Move> &moves = virtReg.moves;
+    std::sort(moves.begin(), moves.end(), [](const Move &m1, const Move &m2) {
+      return m1.virtIndex < m2.virtIndex;
+    });
+    auto out = moves.begin();
+    for (auto it = moves.begin(); it != moves.end(); ++it) {
+      if (std::binary_search(interferences.begin(), interferences.end(),
+                             it->virtIndex)) {
+        continue;
+      }
+      if (out != moves.begin() && std::prev(out)->virtIndex == it->virtIndex) {
+        std::prev(out)->weight += it->weight;
+      } else {
+        *out++ = *it;
+      }
+    }
+    moves.erase(out, moves.end());
+  }
+}
+
+// A register joins the group with exactly its register units, or else starts
+// a new group aliasing every group it shares a unit with.
+auto Registers::addPhys(unsigned id, const std::pmr::vector<unsigned> &unitIds)
+    -> unsigned {
+  if (std::optional<unsigned> groupId = getPhysGroupId(id)) {
+    return *groupId;
+  }
+
+  std::pmr::vector<unsigned> units(unitIds, getMemoryResource());
+  std::sort(units.begin(), units.end());
+  units.erase(std::unique(units.begin(), units.end()), units.end());
 
-  for (unsigned subregId : subregIds) {
-    it = mPhysToGroupidx.find(subregId);
-    if (it != endIt) {
+  unsigned groupId{NoGroup};
+  std::pmr::vector<unsigned> aliases(getMemoryResource());
+  for (unsigned group{getGroupIdFirst()}, e{getGroupIdLast()}; group != e;
+       ++group) {
+    if (mGroupUnits[group] == units) {
+      groupId = group;
       break;
     }
+    if (sharesElement(mGroupUnits[group], units)) {
+      aliases.push_back(group);
+    }
   }
 
-  unsigned groupId;
-  if (it == endIt) {
+  if (groupId == NoGroup) {
     groupId = mGroups.size();
+    // The new group has the highest id, so alias lists stay sorted.
+    for (unsigned alias : aliases) {
+      mGroupAliases[alias].push_back(groupId);
+      mHasGroupAliases = true;
+    }
+    aliases.push_back(groupId);
     mGroups.emplace_back();
-  } else {
-    groupId = it->second;
+    mGroupUnits.push_back(std::move(units));
+    mGroupAliases.push_back(std::move(aliases));
   }
 
-  std::unordered_set<unsigned> &group = mGroups[groupId];
-  group.insert(id);
-  mPhysToGroupidx.insert({id, groupId});
-  for (unsigned subregId : subregIds) {
-    group.insert(subregId);
-    mPhysToGroupidx.insert({subregId, groupId});
+  if (id >= mPhysToGroupidx.size()) {
+    mPhysToGroupidx.resize(id + 1, NoGroup);
   }
+  mPhysToGroupidx[id] = groupId;
+  mGroups[groupId].push_back(id);
   return groupId;
 }
 
@@ -108,11 +370,43 @@ auto Registers::getGroupCount() const -> unsigned { return mGroups.size(); }
 
 auto Registers::getPhysGroupId(unsigned physId) const
     -> std::optional<unsigned> {
-  auto it = mPhysToGroupidx.find(physId);
-  if (it == mPhysToGroupidx.cend()) {
+  if (physId >= mPhysToGroupidx.size() || mPhysToGroupidx[physId] == NoGroup) {
     return {};
   }
-  return it->second;
+  return mPhysToGroupidx[physId];
+}
+
+auto Registers::getGroupPhysIds(unsigned groupId) const
+    -> const std::pmr::vector<unsigned> & {
+  return mGroups[groupId];
+}
+
+auto Registers::getGroupUnitIds(unsigned groupId) const
+    -> const std::pmr::vector<unsigned> & {
+  return mGroupUnits[groupId];
+}
+
+auto Registers::getGroupAliases(unsigned groupId) const
+    -> const std::pmr::vector<unsigned> & {
+  return mGroupAliases[groupId];
+}
+
+auto Registers::hasGroupAliases() const -> bool { return mHasGroupAliases; }
+
+auto Registers::getSqueeze(const VirtualRegister &virtReg,
+                           const VirtualRegister &neighbour) const -> unsigned {
+  if (!mHasGroupAliases) {
+    return 1;
+  }
+  unsigned squeeze{0};
+  for (unsigned candPhysId : neighbour.candidatePhysRegs) {
+    unsigned taken{0};
+    for (unsigned alias : mGroupAliases[mPhysToGroupidx[candPhysId]]) {
+      taken += virtReg.hasCandidateGroup(alias);
+    }
+    squeeze = std::max(squeeze, taken);
+  }
+  return squeeze;
 }
 
 auto Registers::getVirtCandPhysInGroup(unsigned virtId, unsigned groupId) const
@@ -121,51 +415,196 @@ auto Registers::getVirtCandPhysInGroup(unsigned virtId, unsigned groupId) const
   if (!virtReg) {
     return {};
   }
+  return virtReg->getCandPhysInGroup(groupId);
+}
 
-  for (unsigned phys_id : virtReg->candidatePhysRegs) {
-    if (getPhysGroupId(phys_id) == groupId) {
-      return phys_id;
+// Only virtual registers become nodes. Groups are not materialised as a clique
+// of precolored nodes: color i stands for group i, and every group a virtual
+// register has no candidate in is recorded as a forbidden color of its node.
+// Aliasing groups become aliased colors.
+auto Registers::createInterferenceGraph(std::pmr::memory_resource *resource)
+    const -> InterferenceGraph {
+  InterferenceGraph graph(getGroupCount(), getResultResource(resource));
+  unsigned virtOrdinalIdFirst{getVirtOrdinalIdFirst()};
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    const VirtualRegister &virtReg = mVirtRegs[i];
+    graph.addNode(virtOrdinalIdFirst + i, virtReg.weight, virtReg.spillable,
+                  virtReg.rematerializable);
+    for (unsigned group{getGroupIdFirst()}, e{getGroupIdLast()}; group != e;
+         ++group) {
+      if (!virtReg.hasCandidateGroup(group)) {
+        graph.forbidColor(virtOrdinalIdFirst + i, group);
+      }
+    }
+  }
+
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    for (unsigned interference : mVirtRegs[i].interferences) {
+      if (i < interference) {
+        graph.addEdge(virtOrdinalIdFirst + i,
+                      virtOrdinalIdFirst + interference);
+      }
+    }
+    for (const Move &move : mVirtRegs[i].moves) {
+      if (i < move.virtIndex) {
+        graph.addMove(virtOrdinalIdFirst + i,
+                      virtOrdinalIdFirst + move.virtIndex, move.weight);
+      }
     }
   }
-  return {};
+
+  if (mHasGroupAliases) {
+    for (unsigned group{getGroupIdFirst()}, e{getGroupIdLast()}; group != e;
+         ++group) {
+      for (unsigned alias : mGroupAliases[group]) {
+        if (group < alias) {
+          graph.aliasColors(group, alias);
+        }
+      }
+    }
+  }
+  return graph;
 }
 
-auto Registers::createInterferenceGraph() const -> InterferenceGraph {
-  InterferenceGraph graph;
+// Splits the problem into independent subproblems. Virtual registers whose
+// candidate groups overlap or alias, directly or through other virtual
+// registers, stay together, and each subproblem only keeps the groups its
+// virtual registers can be assigned to. Interferences across subproblems are
+// dropped since such registers can never compete for the same register units.
+// Virtual registers without any candidate cannot be colored at all and are
+// left out.
+auto Registers::partitionByGroups(std::pmr::memory_resource *resource) const
+    -> std::vector<Registers> {
+  DisjointSets groupSets(getGroupCount());
+  for (unsigned group{getGroupIdFirst()}, e{getGroupIdLast()}; group != e;
+       ++group) {
+    for (unsigned alias : mGroupAliases[group]) {
+      groupSets.unite(group, alias);
+    }
+  }
+  for (const VirtualRegister &virtReg : mVirtRegs) {
+    std::optional<unsigned> firstGroup;
+    for (unsigned candPhysId : virtReg.candidatePhysRegs) {
+      unsigned group{getPhysGroupId(candPhysId).value()};
+      if (firstGroup) {
+        groupSets.unite(*firstGroup, group);
+      } else {
+        firstGroup = group;
+      }
+    }
+  }
+
+  constexpr unsigned NoPartition{std::numeric_limits<unsigned>::max()};
+  std::vector<unsigned> rootToPartition(getGroupCount(), NoPartition);
+  std::vector<std::vector<unsigned>> partitionGroups;
   for (unsigned group{getGroupIdFirst()}, e{getGroupIdLast()}; group != e;
        ++group) {
-    graph.addNode(group, std::numeric_limits<double>::infinity(), false);
-    for (unsigned j{0}; j != group; ++j) {
-      graph.addEdge(group, j);
+    unsigned root{groupSets.find(group)};
+    if (rootToPartition[root] == NoPartition) {
+      rootToPartition[root] = partitionGroups.size();
+      partitionGroups.emplace_back();
+    }
+    partitionGroups[rootToPartition[root]].push_back(group);
+  }
+
+  std::vector<std::vector<unsigned>> partitionVirts(partitionGroups.size());
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    const VirtualRegister &virtReg = mVirtRegs[i];
+    if (virtReg.candidatePhysRegs.empty()) {
+      continue;
+    }
+    unsigned group{getPhysGroupId(virtReg.candidatePhysRegs.front()).value()};
+    partitionVirts[rootToPartition[groupSets.find(group)]].push_back(i);
+  }
+
+  std::vector<Registers> partitions;
+  std::vector<unsigned> indexMap(getVirtCount(), NoIndex);
+  for (std::size_t i{0}; i != partitionGroups.size(); ++i) {
+    if (!partitionVirts[i].empty()) {
+      partitions.push_back(
+          extract(partitionGroups[i], partitionVirts[i], indexMap, resource));
     }
   }
+  return partitions;
+}
 
-  for (unsigned virt{getVirtOrdinalIdFirst()}, e{getVirtOrdinalIdLast()};
-       virt != e; ++virt) {
-    const VirtualRegister *virtReg = getVirtReg(getVirtId(virt).value());
-    graph.addNode(virt, virtReg->weight, virtReg->spillable);
+// Splits the problem into the connected components of the virtual register
+// interference graph. Registers joined by a move stay in the same component so
+// that the solver can still give them the same group. Every component keeps
+// the groups its virtual registers are candidates for.
+auto Registers::splitComponents(std::pmr::memory_resource *resource) const
+    -> std::vector<Registers> {
+  DisjointSets virtSets(getVirtCount());
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    for (unsigned interference : mVirtRegs[i].interferences) {
+      virtSets.unite(i, interference);
+    }
+    for (const Move &move : mVirtRegs[i].moves) {
+      virtSets.unite(i, move.virtIndex);
+    }
+  }
 
-    std::unordered_set<unsigned> candidateGroups;
-    for (unsigned candPhysId : virtReg->candidatePhysRegs) {
-      candidateGroups.insert(getPhysGroupId(candPhysId).value());
+  constexpr unsigned NoComponent{std::numeric_limits<unsigned>::max()};
+  std::vector<unsigned> rootToComponent(getVirtCount(), NoComponent);
+  std::vector<std::vector<unsigned>> componentVirts;
+  std::vector<std::vector<std::uint64_t>> componentGroups;
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    unsigned root{virtSets.find(i)};
+    if (rootToComponent[root] == NoComponent) {
+      rootToComponent[root] = componentVirts.size();
+      componentVirts.emplace_back();
+      componentGroups.emplace_back();
+    }
+    unsigned component{rootToComponent[root]};
+    componentVirts[component].push_back(i);
+    std::vector<std::uint64_t> &groups = componentGroups[component];
+    const std::pmr::vector<std::uint64_t> &candidateGroups =
+        mVirtRegs[i].candidateGroups;
+    if (groups.size() < candidateGroups.size()) {
+      groups.resize(candidateGroups.size());
+    }
+    for (std::size_t word{0}; word != candidateGroups.size(); ++word) {
+      groups[word] |= candidateGroups[word];
     }
+  }
 
+  std::vector<Registers> components;
+  std::vector<unsigned> indexMap(getVirtCount(), NoIndex);
+  for (std::size_t i{0}; i != componentVirts.size(); ++i) {
+    std::vector<unsigned> groupIds;
     for (unsigned group{getGroupIdFirst()}, e{getGroupIdLast()}; group != e;
          ++group) {
-      if (!candidateGroups.count(group)) {
-        graph.addEdge(virt, group);
+      if (testBit(componentGroups[i], group)) {
+        groupIds.push_back(group);
       }
     }
+    components.push_back(
+        extract(groupIds, componentVirts[i], indexMap, resource));
   }
+  return components;
+}
 
-  for (unsigned virt{getVirtOrdinalIdFirst()}, e{getVirtOrdinalIdLast()};
-       virt != e; ++virt) {
-    const VirtualRegister *virtReg = getVirtReg(getVirtId(virt).value());
-    for (unsigned interference : virtReg->interferences) {
-      graph.addEdge(virt, getVirtOrdinalId(interference).value());
-    }
-  }
-  return graph;
+// A problem is trivially colorable when every virtual register has more
+// candidate groups than its neighbours can take, one group or its squeeze
+// each: whatever they get, one of its groups is always left, so it can be
+// colored in any order. Interferences have to be finalized for the counts to
+// be exact.
+auto Registers::isTriviallyColorable() const -> bool {
+  return std::all_of(
+      mVirtRegs.begin(), mVirtRegs.end(), [&](const VirtualRegister &virtReg) {
+        if (!mHasGroupAliases) {
+          return virtReg.interferences.size() <
+                 virtReg.candidatePhysRegs.size();
+        }
+        std::size_t taken{0};
+        for (unsigned interference : virtReg.interferences) {
+          taken += getSqueeze(virtReg, mVirtRegs[interference]);
+          if (taken >= virtReg.candidatePhysRegs.size()) {
+            return false;
+          }
+        }
+        return taken < virtReg.candidatePhysRegs.size();
+      });
 }
 
 auto Registers::print(std::ostream &os) const -> std::ostream & {
@@ -173,9 +612,56 @@ auto Registers::print(std::ostream &os) const -> std::ostream & {
   return printPhys(os);
 }
 
-auto Registers::getVirtReg(unsigned int virtId) -> VirtualRegister * {
-  auto it = mVirtRegs.find(virtId);
-  return (it == mVirtRegs.end()) ? nullptr : &it->second;
+// Builds a new problem from the given groups and virtual registers, keeping
+// the interferences and moves among the selected virtual registers. Candidates outside
+// the selected groups are dropped. virtIndices are ordinal indices into this
+// problem; indexMap is scratch space of getVirtCount() NoIndex entries that is
+// left in that state on return.
+auto Registers::extract(const std::vector<unsigned> &groupIds,
+                        const std::vector<unsigned> &virtIndices,
+                        std::vector<unsigned> &indexMap,
+                        std::pmr::memory_resource *resource) const
+    -> Registers {
+  Registers registers(getResultResource(resource));
+  for (unsigned group : groupIds) {
+    for (unsigned physId : mGroups[group]) {
+      registers.addPhys(physId, mGroupUnits[group]);
+    }
+  }
+
+  for (unsigned i : virtIndices) {
+    const VirtualRegister &virtReg = mVirtRegs[i];
+    indexMap[i] = registers.getVirtCount();
+    registers.addVirt(mVirtOrdinalToVirt[i], virtReg.candidatePhysRegs,
+                      virtReg.weight, virtReg.spillable,
+                      virtReg.rematerializable);
+  }
+
+  for (unsigned i : virtIndices) {
+    VirtualRegister &virtReg = registers.mVirtRegs[indexMap[i]];
+    for (unsigned interference : mVirtRegs[i].interferences) {
+      if (indexMap[interference] != NoIndex) {
+        virtReg.interferences.push_back(indexMap[interference]);
+      }
+    }
+    for (const Move &move : mVirtRegs[i].moves) {
+      if (indexMap[move.virtIndex] != NoIndex) {
+        virtReg.moves.push_back({indexMap[move.virtIndex], move.weight});
+      }
+    }
+    registers.mUnfinalized[indexMap[i]] = true;
+  }
+
+  for (unsigned i : virtIndices) {
+    indexMap[i] = NoIndex;
+  }
+  registers.finalizeInterferences();
+  return registers;
+}
+
+auto Registers::getResultResource(std::pmr::memory_resource *resource) const
+    -> std::pmr::memory_resource * {
+  return resource ? resource : getMemoryResource();
 }
 
 auto Registers::printVirtOrdinal(std::ostream &os) const -> std::ostream & {
@@ -195,12 +681,15 @@ auto Registers::printVirtOrdinal(std::ostream &os) const -> std::ostream & {
 auto Registers::printVirt(std::ostream &os) const -> std::ostream & {
   bool firstVirt{true};
   os << '{';
-  for (auto [virtId, virtReg] : mVirtRegs) {
+  for (unsigned i{0}; i != mVirtRegs.size(); ++i) {
+    const VirtualRegister &virtReg = mVirtRegs[i];
     if (!firstVirt) {
       os << ",\n";
     }
-    os << virtId << ": {" << "WE: " << virtReg.weight
-       << ", IS: " << (virtReg.spillable ? "true" : "false") << ", PH: {";
+    os << mVirtOrdinalToVirt[i] << ": {" << "WE: " << virtReg.weight
+       << ", IS: " << (virtReg.spillable ? "true" : "false")
+       << ", RM: " << (virtReg.rematerializable ? "true" : "false")
+       << ", PH: {";
     bool firstPhys{true};
     for (unsigned physId : virtReg.candidatePhysRegs) {
       if (!firstPhys) {
@@ -211,11 +700,11 @@ auto Registers::printVirt(std::ostream &os) const -> std::ostream & {
     }
     os << "}, IN: {";
     bool firstInterference{true};
-    for (unsigned interferenceVirtId : virtReg.interferences) {
+    for (unsigned interference : virtReg.interferences) {
       if (!firstInterference) {
         os << ", ";
       }
-      os << interferenceVirtId;
+      os << mVirtOrdinalToVirt[interference];
       firstInterference = false;
     }
     os << "}}";
@@ -251,43 +740,21 @@ auto Registers::printPhys(std::ostream &os) const -> std::ostream & {
 auto convertSolutionMapToSolutionMapLLVM(const Registers &registers,
                                          const SolutionMap &solution)
     -> std::optional<SolutionMapLLVM> {
-  std::size_t numberOfColors{0};
-  std::unordered_map<std::size_t, unsigned> colorToGroupMapping;
-  for (unsigned group{registers.getGroupIdFirst()},
-       e{registers.getGroupIdLast()};
-       group != e; ++group) {
-    auto it = solution.find(group);
-    if (it == solution.end()) {
-      return {};
-    }
-
-    std::size_t color{it->second};
-    if (colorToGroupMapping.count(color)) {
-      return {};
-    }
-
-    colorToGroupMapping.insert({it->second, group});
-    ++numberOfColors;
-  }
-
-  if (numberOfColors > registers.getGroupCount()) {
-    return {};
-  }
-
   SolutionMapLLVM solutionLLVM;
   unsigned virtOrdinalIdFirst{registers.getVirtOrdinalIdFirst()};
   unsigned virtOrdinalIdLast{registers.getVirtOrdinalIdLast()};
-  for (auto [reg, color] : solution) {
-    if (virtOrdinalIdFirst <= reg && reg < virtOrdinalIdLast) {
-      if (std::optional<unsigned> virtId = registers.getVirtId(reg)) {
-        if (std::optional<unsigned> physId = registers.getVirtCandPhysInGroup(
-                *virtId, colorToGroupMapping[color])) {
-          solutionLLVM.insert({*virtId, *physId});
-          continue;
-        }
-      }
+  for (unsigned reg{virtOrdinalIdFirst};
+       reg < virtOrdinalIdLast && reg < solution.size(); ++reg) {
+    unsigned color{solution[reg]};
+    if (color == NoColor) {
+      continue;
+    }
+    std::optional<unsigned> physId =
+        registers.getVirtRegByOrdinal(reg)->getCandPhysInGroup(color);
+    if (!physId) {
       return {};
     }
+    solutionLLVM.insert({registers.getVirtId(reg).value(), *physId});
   }
   return solutionLLVM;
 }
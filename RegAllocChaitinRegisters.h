@@ -2,29 +2,74 @@
 
 #include "RegAllocChaitinGraph.h"
 
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
 #include <optional>
 #include <ostream>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 namespace alihan {
-using SolutionMap = std::unordered_map<unsigned, unsigned>;
+// Color of every graph node indexed by node id, NoColor for uncolored ones.
+using SolutionMap = std::vector<unsigned>;
+inline constexpr unsigned NoColor{std::numeric_limits<unsigned>::max()};
 using SolutionMapLLVM = std::unordered_map<unsigned, unsigned>;
 
+// A coloring problem. Physical registers that occupy the same register units
+// form a group, and every group is one color. Groups whose units overlap, like
+// a register and one of its subregisters, alias: virtual registers that
+// interfere can not take one each.
 class Registers {
 public:
-  struct VirtualRegister {
+  // A copy between two virtual registers, weighted by execution frequency.
+  struct Move {
+    unsigned virtIndex;
     double weight;
-    bool spillable;
-    std::unordered_set<unsigned> interferences;
-    std::unordered_set<unsigned> candidatePhysRegs;
   };
 
-  void addVirt(unsigned id, std::unordered_set<unsigned> candidatePhysIds,
-               double weight, bool spillable);
+  struct VirtualRegister {
+    explicit VirtualRegister(std::pmr::memory_resource *resource);
+
+    double weight{0.0};
+    bool spillable{false};
+    // Every value can be recomputed where it is needed instead of being
+    // reloaded, so spilling costs neither stores nor loads.
+    bool rematerializable{false};
+    // Ordinal indices (ordinal id minus getVirtOrdinalIdFirst) of the
+    // interfering virtual registers. Sorted and free of duplicates once
+    // finalizeInterferences has run.
+    std::pmr::vector<unsigned> interferences;
+    // Bitmask over group ids of the groups with a candidate register.
+    std::pmr::vector<std::uint64_t> candidateGroups;
+    // One candidate register per candidate group, in group order.
+    std::pmr::vector<unsigned> candidatePhysRegs;
+    // Copies to and from other virtual registers, indexed like interferences.
+    // Once finalizeInterferences has run there is one entry per register, and
+    // none to registers this one interferes with.
+    std::pmr::vector<Move> moves;
+
+    [[nodiscard]] auto hasCandidateGroup(unsigned groupId) const -> bool;
+    [[nodiscard]] auto getCandPhysInGroup(unsigned groupId) const -> std::optional<unsigned>;
+  };
+
+  Registers() = default;
+  // All memory of the problem comes from resource, except that of copies.
+  explicit Registers(std::pmr::memory_resource *resource);
+
+  [[nodiscard]] auto getMemoryResource() const -> std::pmr::memory_resource *;
+
+  // Candidates must already be registered with addPhys. Only the first
+  // candidate of every group is kept, so candidatePhysIds should be in
+  // allocation order.
+  void addVirt(unsigned id, const std::pmr::vector<unsigned> &candidatePhysIds,
+               double weight, bool spillable, bool rematerializable = false);
+  // Removes a virtual register with all its interferences and moves. The last
+  // virtual register takes over its ordinal id.
+  auto removeVirt(unsigned id) -> bool;
   [[nodiscard]] auto getVirtCount() const -> unsigned;
   [[nodiscard]] auto getVirtReg(unsigned virtId) const -> const VirtualRegister *;
+  [[nodiscard]] auto getVirtRegByOrdinal(unsigned virtOrdinalId) const -> const VirtualRegister *;
   [[nodiscard]] auto getVirtOrdinalId(unsigned virtId) const -> std::optional<unsigned>;
   [[nodiscard]] auto getVirtId(unsigned virtOrdinalId) const -> std::optional<unsigned>;
   [[nodiscard]] auto getGroupIdFirst() const -> unsigned;
@@ -32,24 +77,57 @@ public:
   [[nodiscard]] auto getVirtOrdinalIdFirst() const -> unsigned;
   [[nodiscard]] auto getVirtOrdinalIdLast() const -> unsigned;
   auto addVirtInterference(unsigned virtId1, unsigned virtId2) -> bool;
-  auto addPhys(unsigned id, std::vector<unsigned> const &subregIds) -> unsigned;
+  auto addVirtMove(unsigned virtId1, unsigned virtId2, double weight) -> bool;
+  void finalizeInterferences();
+  // Returns the group of the physical register, whose register units are
+  // unitIds.
+  auto addPhys(unsigned id, const std::pmr::vector<unsigned> &unitIds) -> unsigned;
   [[nodiscard]] auto getGroupCount() const -> unsigned;
+  // Register units of a group, sorted.
+  [[nodiscard]] auto getGroupUnitIds(unsigned groupId) const -> const std::pmr::vector<unsigned> &;
+  // Groups sharing a register unit with a group, the group itself included.
+  // Sorted.
+  [[nodiscard]] auto getGroupAliases(unsigned groupId) const -> const std::pmr::vector<unsigned> &;
+  [[nodiscard]] auto hasGroupAliases() const -> bool;
+  // The number of candidate groups of virtReg that a single candidate group of
+  // neighbour can take away, at most. Without group aliases this is 1.
+  [[nodiscard]] auto getSqueeze(const VirtualRegister &virtReg, const VirtualRegister &neighbour) const -> unsigned;
   [[nodiscard]] auto getPhysGroupId(unsigned physId) const -> std::optional<unsigned>;
+  // Physical registers of a group, the one first passed to addPhys first.
+  [[nodiscard]] auto getGroupPhysIds(unsigned groupId) const -> const std::pmr::vector<unsigned> &;
   [[nodiscard]] auto getVirtCandPhysInGroup(unsigned virtId, unsigned groupId) const -> std::optional<unsigned>;
-  [[nodiscard]] auto createInterferenceGraph() const -> InterferenceGraph;
+  // The results allocate from resource, or from the resource of this problem
+  // if it is null.
+  [[nodiscard]] auto createInterferenceGraph(std::pmr::memory_resource *resource = nullptr) const -> InterferenceGraph;
+  [[nodiscard]] auto partitionByGroups(std::pmr::memory_resource *resource = nullptr) const -> std::vector<Registers>;
+  [[nodiscard]] auto splitComponents(std::pmr::memory_resource *resource = nullptr) const -> std::vector<Registers>;
+  [[nodiscard]] auto isTriviallyColorable() const -> bool;
   std::ostream &print(std::ostream &os) const;
 
 private:
-  [[nodiscard]] auto getVirtReg(unsigned virtId) -> VirtualRegister *;
+  [[nodiscard]] auto extract(const std::vector<unsigned> &groupIds,
+                             const std::vector<unsigned> &virtIndices,
+                             std::vector<unsigned> &indexMap,
+                             std::pmr::memory_resource *resource) const
+      -> Registers;
+  [[nodiscard]] auto getResultResource(std::pmr::memory_resource *resource) const
+      -> std::pmr::memory_resource *;
   std::ostream &printVirtOrdinal(std::ostream &os) const;
   std::ostream &printVirt(std::ostream &os) const;
   std::ostream &printPhys(std::ostream &os) const;
 
-  std::unordered_map<unsigned, VirtualRegister> mVirtRegs;
-  std::unordered_map<unsigned, unsigned> mVirtToVirtOrdinal;
-  std::vector<unsigned> mVirtOrdinalToVirt;
-  std::unordered_map<unsigned, unsigned> mPhysToGroupidx;
-  std::vector<std::unordered_set<unsigned>> mGroups;
+  // Virtual registers are stored in ordinal order.
+  std::pmr::vector<VirtualRegister> mVirtRegs;
+  // Registers whose interferences or moves changed since the last
+  // finalizeInterferences, indexed like mVirtRegs.
+  std::pmr::vector<char> mUnfinalized;
+  std::pmr::unordered_map<unsigned, unsigned> mVirtToVirtOrdinal;
+  std::pmr::vector<unsigned> mVirtOrdinalToVirt;
+  std::pmr::vector<unsigned> mPhysToGroupidx;
+  std::pmr::vector<std::pmr::vector<unsigned>> mGroups;
+  std::pmr::vector<std::pmr::vector<unsigned>> mGroupUnits;
+  std::pmr::vector<std::pmr::vector<unsigned>> mGroupAliases;
+  bool mHasGroupAliases{false};
 };
 
 [[nodiscard]] auto convertSolutionMapToSolutionMapLLVM(
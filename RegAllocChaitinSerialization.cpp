@@ -0,0 +1,319 @@
+#include "RegAllocChaitinSerialization.h"
+#include "RegAllocChaitinRegisters.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr char Magic[8]{'C', 'H', 'A', 'I', 'T', 'I', 'N', '\0'};
+constexpr std::uint32_t ByteOrderMark{0x01020304};
+constexpr std::size_t Alignment{8};
+// Registers keeps a table indexed by physical register id. No target comes
+// close to this many registers, so larger ids mean the dump is corrupt.
+constexpr std::uint32_t MaxPhysId{1u << 20};
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint32_t virtCount;
+  std::uint32_t groupCount;
+  std::uint32_t physCount;
+  std::uint32_t unitCount;
+  std::uint32_t candidateCount;
+  std::uint32_t interferenceCount;
+  std::uint32_t moveCount;
+  std::uint32_t reserved;
+};
+static_assert(sizeof(Header) % Alignment == 0);
+
+class Writer {
+public:
+  template <typename T> void write(const T *values, std::size_t count);
+  template <typename T> void write(const std::vector<T> &values) {
+    write(values.data(), values.size());
+  }
+  [[nodiscard]] auto take() -> std::vector<char> { return std::move(mData); }
+
+private:
+  std::vector<char> mData;
+};
+
+template <typename T> void Writer::write(const T *values, std::size_t count) {
+  mData.resize((mData.size() + Alignment - 1) / Alignment * Alignment);
+  std::size_t offset{mData.size()};
+  mData.resize(offset + count * sizeof(T));
+  if (count) {
+    std::memcpy(mData.data() + offset, values, count * sizeof(T));
+  }
+}
+
+// An array inside the dump. Elements are copied out, so the dump does not need
+// to be aligned in memory.
+template <typename T> class ArrayView {
+public:
+  ArrayView() = default;
+  ArrayView(const char *data, std::size_t count)
+      : mData(data), mCount(count) {}
+  [[nodiscard]] auto size() const -> std::size_t { return mCount; }
+  [[nodiscard]] auto operator[](std::size_t i) const -> T {
+    T value;
+    std::memcpy(&value, mData + i * sizeof(T), sizeof(T));
+    return value;
+  }
+
+private:
+  const char *mData{nullptr};
+  std::size_t mCount{0};
+};
+
+class Reader {
+public:
+  Reader(const char *data, std::size_t size) : mData(data), mSize(size) {}
+  // Returns nothing if the array does not fit into the rest of the data.
+  template <typename T>
+  [[nodiscard]] auto read(std::size_t count) -> std::optional<ArrayView<T>>;
+
+private:
+  const char *mData;
+  std::size_t mSize;
+  std::size_t mOffset{0};
+};
+
+template <typename T>
+auto Reader::read(std::size_t count) -> std::optional<ArrayView<T>> {
+  std::size_t offset{(mOffset + Alignment - 1) / Alignment * Alignment};
+  if (offset > mSize || count > (mSize - offset) / sizeof(T)) {
+    return {};
+  }
+  mOffset = offset + count * sizeof(T);
+  return ArrayView<T>(mData + offset, count);
+}
+
+// Offsets must start at 0, never decrease and end at the length of the array
+// they index.
+auto isValidOffsets(const ArrayView<std::uint32_t> &offsets,
+                    std::size_t arraySize) -> bool {
+  if (offsets[0] != 0 || offsets[offsets.size() - 1] != arraySize) {
+    return false;
+  }
+  for (std::size_t i{1}; i != offsets.size(); ++i) {
+    if (offsets[i] < offsets[i - 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+namespace alihan {
+auto serializeRegisters(const Registers &registers) -> std::vector<char> {
+  unsigned virtOrdinalIdFirst{registers.getVirtOrdinalIdFirst()};
+  std::vector<double> weights;
+  std::vector<double> moveWeights;
+  std::vector<std::uint32_t> virtIds;
+  std::vector<std::uint32_t> spillable;
+  std::vector<std::uint32_t> rematerializable;
+  std::vector<std::uint32_t> groupOffsets{0};
+  std::vector<std::uint32_t> physIds;
+  std::vector<std::uint32_t> unitOffsets{0};
+  std::vector<std::uint32_t> unitIds;
+  std::vector<std::uint32_t> candidateOffsets{0};
+  std::vector<std::uint32_t> candidates;
+  std::vector<std::uint32_t> interferenceOffsets{0};
+  std::vector<std::uint32_t> interferences;
+  std::vector<std::uint32_t> moveOffsets{0};
+  std::vector<std::uint32_t> movePartners;
+
+  for (unsigned group{registers.getGroupIdFirst()},
+       e{registers.getGroupIdLast()};
+       group != e; ++group) {
+    const std::pmr::vector<unsigned> &groupPhysIds =
+        registers.getGroupPhysIds(group);
+    physIds.insert(physIds.end(), groupPhysIds.begin(), groupPhysIds.end());
+    groupOffsets.push_back(physIds.size());
+    const std::pmr::vector<unsigned> &groupUnitIds =
+        registers.getGroupUnitIds(group);
+    unitIds.insert(unitIds.end(), groupUnitIds.begin(), groupUnitIds.end());
+    unitOffsets.push_back(unitIds.size());
+  }
+
+  for (unsigned virt{virtOrdinalIdFirst}, e{registers.getVirtOrdinalIdLast()};
+       virt != e; ++virt) {
+    unsigned index{virt - virtOrdinalIdFirst};
+    const Registers::VirtualRegister *virtReg =
+        registers.getVirtRegByOrdinal(virt);
+    weights.push_back(virtReg->weight);
+    virtIds.push_back(registers.getVirtId(virt).value());
+    spillable.push_back(virtReg->spillable);
+    rematerializable.push_back(virtReg->rematerializable);
+    candidates.insert(candidates.end(), virtReg->candidatePhysRegs.begin(),
+                      virtReg->candidatePhysRegs.end());
+    candidateOffsets.push_back(candidates.size());
+    for (unsigned interference : virtReg->interferences) {
+      if (interference > index) {
+        interferences.push_back(interference);
+      }
+    }
+    interferenceOffsets.push_back(interferences.size());
+    for (const Registers::Move &move : virtReg->moves) {
+      if (move.virtIndex > index) {
+        movePartners.push_back(move.virtIndex);
+        moveWeights.push_back(move.weight);
+      }
+    }
+    moveOffsets.push_back(movePartners.size());
+  }
+
+  Header header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = SerializationVersion;
+  header.byteOrder = ByteOrderMark;
+  header.virtCount = virtIds.size();
+  header.groupCount = registers.getGroupCount();
+  header.physCount = physIds.size();
+  header.unitCount = unitIds.size();
+  header.candidateCount = candidates.size();
+  header.interferenceCount = interferences.size();
+  header.moveCount = movePartners.size();
+
+  Writer writer;
+  writer.write(&header, 1);
+  writer.write(weights);
+  writer.write(moveWeights);
+  writer.write(virtIds);
+  writer.write(spillable);
+  writer.write(rematerializable);
+  writer.write(groupOffsets);
+  writer.write(physIds);
+  writer.write(unitOffsets);
+  writer.write(unitIds);
+  writer.write(candidateOffsets);
+  writer.write(candidates);
+  writer.write(interferenceOffsets);
+  writer.write(interferences);
+  writer.write(moveOffsets);
+  writer.write(movePartners);
+  return writer.take();
+}
+
+auto deserializeRegisters(const char *data, std::size_t size)
+    -> std::optional<Registers> {
+  Reader reader(data, size);
+  std::optional<ArrayView<Header>> headerView = reader.read<Header>(1);
+  if (!headerView) {
+    return {};
+  }
+  Header header{(*headerView)[0]};
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+      header.version != SerializationVersion ||
+      header.byteOrder != ByteOrderMark) {
+    return {};
+  }
+
+  std::size_t virtCount{header.virtCount};
+  auto weights = reader.read<double>(virtCount);
+  auto moveWeights = reader.read<double>(header.moveCount);
+  auto virtIds = reader.read<std::uint32_t>(virtCount);
+  auto spillable = reader.read<std::uint32_t>(virtCount);
+  auto rematerializable = reader.read<std::uint32_t>(virtCount);
+  auto groupOffsets =
+      reader.read<std::uint32_t>(std::size_t{header.groupCount} + 1);
+  auto physIds = reader.read<std::uint32_t>(header.physCount);
+  auto unitOffsets =
+      reader.read<std::uint32_t>(std::size_t{header.groupCount} + 1);
+  auto unitIds = reader.read<std::uint32_t>(header.unitCount);
+  auto candidateOffsets = reader.read<std::uint32_t>(virtCount + 1);
+  auto candidates = reader.read<std::uint32_t>(header.candidateCount);
+  auto interferenceOffsets = reader.read<std::uint32_t>(virtCount + 1);
+  auto interferences = reader.read<std::uint32_t>(header.interferenceCount);
+  auto moveOffsets = reader.read<std::uint32_t>(virtCount + 1);
+  auto movePartners = reader.read<std::uint32_t>(header.moveCount);
+  if (!weights || !moveWeights || !virtIds || !spillable ||
+      !rematerializable || !groupOffsets || !physIds || !unitOffsets ||
+      !unitIds || !candidateOffsets || !candidates || !interferenceOffsets ||
+      !interferences || !moveOffsets || !movePartners ||
+      !isValidOffsets(*groupOffsets, header.physCount) ||
+      !isValidOffsets(*unitOffsets, header.unitCount) ||
+      !isValidOffsets(*candidateOffsets, header.candidateCount) ||
+      !isValidOffsets(*interferenceOffsets, header.interferenceCount) ||
+      !isValidOffsets(*moveOffsets, header.moveCount)) {
+    return {};
+  }
+
+  // The problem is rebuilt through the usual interface. Group ids and ordinal
+  // ids are handed out in insertion order, so they come out as they were
+  // written, and anything addPhys or addVirt would silently merge or drop
+  // means the dump is malformed.
+  Registers registers;
+  std::pmr::vector<unsigned> groupUnitIds;
+  for (unsigned group{0}; group != header.groupCount; ++group) {
+    std::uint32_t first{(*groupOffsets)[group]};
+    std::uint32_t last{(*groupOffsets)[group + 1]};
+    if (first == last) {
+      return {};
+    }
+    groupUnitIds.clear();
+    for (std::uint32_t i{(*unitOffsets)[group]}, e{(*unitOffsets)[group + 1]};
+         i != e; ++i) {
+      groupUnitIds.push_back((*unitIds)[i]);
+    }
+    for (std::uint32_t i{first}; i != last; ++i) {
+      if ((*physIds)[i] >= MaxPhysId ||
+          registers.addPhys((*physIds)[i], groupUnitIds) != group) {
+        return {};
+      }
+    }
+    if (registers.getGroupPhysIds(group).size() != last - first) {
+      return {};
+    }
+  }
+
+  std::pmr::vector<unsigned> candidatePhysIds;
+  for (unsigned index{0}; index != header.virtCount; ++index) {
+    candidatePhysIds.clear();
+    for (std::uint32_t i{(*candidateOffsets)[index]},
+         e{(*candidateOffsets)[index + 1]};
+         i != e; ++i) {
+      candidatePhysIds.push_back((*candidates)[i]);
+    }
+    registers.addVirt((*virtIds)[index], candidatePhysIds, (*weights)[index],
+                      (*spillable)[index] != 0,
+                      (*rematerializable)[index] != 0);
+    const Registers::VirtualRegister *virtReg =
+        registers.getVirtReg((*virtIds)[index]);
+    if (registers.getVirtCount() != index + 1 ||
+        virtReg->candidatePhysRegs.size() != candidatePhysIds.size()) {
+      return {};
+    }
+  }
+
+  for (unsigned index{0}; index != header.virtCount; ++index) {
+    for (std::uint32_t i{(*interferenceOffsets)[index]},
+         e{(*interferenceOffsets)[index + 1]};
+         i != e; ++i) {
+      std::uint32_t other{(*interferences)[i]};
+      if (other <= index || other >= header.virtCount) {
+        return {};
+      }
+      registers.addVirtInterference((*virtIds)[index], (*virtIds)[other]);
+    }
+    for (std::uint32_t i{(*moveOffsets)[index]}, e{(*moveOffsets)[index + 1]};
+         i != e; ++i) {
+      std::uint32_t other{(*movePartners)[i]};
+      if (other <= index || other >= header.virtCount) {
+        return {};
+      }
+      registers.addVirtMove((*virtIds)[index], (*virtIds)[other],
+                            (*moveWeights)[i]);
+    }
+  }
+  registers.finalizeInterferences();
+  return registers;
+}
+} // namespace alihan
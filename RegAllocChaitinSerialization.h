@@ -0,0 +1,40 @@
+#pragma once
+
+#include "RegAllocChaitinRegisters.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace alihan {
+// Binary dumps of allocation problems, so that problems captured from real
+// compiles can be replayed on the solvers outside of the compiler.
+//
+// A dump is a fixed size header followed by flat arrays, each starting at a
+// multiple of 8 bytes, in the byte order of the machine that wrote it:
+//
+//   header    magic, version, byte order mark and the array lengths
+//   double    weight of every virtual register
+//   double    weight of every move
+//   uint32    id of every virtual register
+//   uint32    spillable flag of every virtual register
+//   uint32    rematerializable flag of every virtual register
+//   uint32    group offsets, then the physical registers of all groups
+//   uint32    unit offsets, then the register units of all groups
+//   uint32    candidate offsets, then the candidates of all registers
+//   uint32    interference offsets, then the interferences of all registers
+//   uint32    move offsets, then the move partners of all registers
+//
+// Offset arrays have one more entry than there are groups or virtual
+// registers and index into the array that follows them. Interferences and
+// moves are stored once, at the register with the lower ordinal index, as the
+// ordinal index of the other register. Nothing needs to be parsed, so a
+// memory mapped dump can be read in place.
+inline constexpr std::uint32_t SerializationVersion{3};
+
+// registers must have been finalized.
+[[nodiscard]] auto serializeRegisters(const Registers &registers) -> std::vector<char>;
+// Returns nothing if data is not a well formed dump of this version.
+[[nodiscard]] auto deserializeRegisters(const char *data, std::size_t size) -> std::optional<Registers>;
+} // namespace alihan
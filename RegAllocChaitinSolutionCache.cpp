@@ -0,0 +1,120 @@
+#include "RegAllocChaitinSolutionCache.h"
+#include "RegAllocChaitinRegisters.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace {
+auto toWord(double value) -> std::uint64_t {
+  std::uint64_t word;
+  static_assert(sizeof(word) == sizeof(value));
+  std::memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+// Combines like boost::hash_combine, then scrambles the result with the
+// splitmix64 finalizer.
+auto mix(std::uint64_t hash, std::uint64_t word) -> std::uint64_t {
+  hash ^= word + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+  return hash ^ (hash >> 31);
+}
+} // namespace
+
+namespace alihan {
+auto SolutionCache::makeKey(const Registers &registers, unsigned solverId)
+    -> Key {
+  Key key;
+  std::vector<std::uint64_t> &words = key.words;
+  words.push_back(solverId);
+  words.push_back(registers.getGroupCount());
+  // Which groups alias decides which colorings are valid.
+  for (unsigned group{registers.getGroupIdFirst()},
+       e{registers.getGroupIdLast()};
+       group != e; ++group) {
+    const std::pmr::vector<unsigned> &unitIds =
+        registers.getGroupUnitIds(group);
+    words.push_back(unitIds.size());
+    words.insert(words.end(), unitIds.begin(), unitIds.end());
+  }
+  words.push_back(registers.getVirtCount());
+  for (unsigned virt{registers.getVirtOrdinalIdFirst()},
+       e{registers.getVirtOrdinalIdLast()};
+       virt != e; ++virt) {
+    const Registers::VirtualRegister *virtReg =
+        registers.getVirtRegByOrdinal(virt);
+    words.push_back(toWord(virtReg->weight));
+    words.push_back(virtReg->spillable);
+    words.push_back(virtReg->rematerializable);
+    // Trailing zero words carry no information and are not always present.
+    std::size_t groupWordCount{virtReg->candidateGroups.size()};
+    while (groupWordCount && !virtReg->candidateGroups[groupWordCount - 1]) {
+      --groupWordCount;
+    }
+    words.push_back(groupWordCount);
+    words.insert(words.end(), virtReg->candidateGroups.begin(),
+                 virtReg->candidateGroups.begin() + groupWordCount);
+    words.push_back(virtReg->interferences.size());
+    words.insert(words.end(), virtReg->interferences.begin(),
+                 virtReg->interferences.end());
+    words.push_back(virtReg->moves.size());
+    for (const Registers::Move &move : virtReg->moves) {
+      words.push_back(move.virtIndex);
+      words.push_back(toWord(move.weight));
+    }
+  }
+
+  key.hash = 0;
+  for (std::uint64_t word : words) {
+    key.hash = mix(key.hash, word);
+  }
+  return key;
+}
+
+auto SolutionCache::lookup(const Key &key) -> std::optional<SolutionMap> {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mEntries.find(key.hash);
+  if (it == mEntries.end()) {
+    return {};
+  }
+  for (const Entry &entry : it->second) {
+    if (entry.words == key.words) {
+      return entry.solution;
+    }
+  }
+  return {};
+}
+
+void SolutionCache::insert(Key key, SolutionMap solution) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mSize >= mCapacity) {
+    return;
+  }
+  std::vector<Entry> &entries = mEntries[key.hash];
+  for (const Entry &entry : entries) {
+    if (entry.words == key.words) {
+      return;
+    }
+  }
+  entries.push_back({std::move(key.words), std::move(solution)});
+  ++mSize;
+}
+
+void SolutionCache::setCapacity(std::size_t capacity) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mCapacity = capacity;
+}
+
+void SolutionCache::clear() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mEntries.clear();
+  mSize = 0;
+}
+} // namespace alihan
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "RegAllocChaitinRegisters.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace alihan {
+// Remembers solutions of problems solved before, so identical problems from
+// different functions, such as those of near identical template
+// instantiations, are only solved once.
+//
+// Problems are identified by a key holding everything a solver looks at:
+// ordinal indices, weights, spillability, candidate groups, interferences and
+// moves, plus an id for the solver. Virtual and physical register ids are
+// left out, as solutions are in terms of ordinal ids and group ids only. The
+// key is not invariant under renumbering the virtual registers, but identical
+// functions number them identically. Lookups hash the key and compare it in
+// full, so a hash collision can never return a wrong solution.
+//
+// All member functions may be called concurrently.
+class SolutionCache {
+public:
+  struct Key {
+    std::vector<std::uint64_t> words;
+    std::uint64_t hash;
+  };
+
+  [[nodiscard]] static auto makeKey(const Registers &registers, unsigned solverId) -> Key;
+  [[nodiscard]] auto lookup(const Key &key) -> std::optional<SolutionMap>;
+  // Does nothing once capacity solutions are stored.
+  void insert(Key key, SolutionMap solution);
+  void setCapacity(std::size_t capacity);
+  void clear();
+
+private:
+  struct Entry {
+    std::vector<std::uint64_t> words;
+    SolutionMap solution;
+  };
+
+  std::mutex mMutex;
+  std::unordered_map<std::uint64_t, std::vector<Entry>> mEntries;
+  std::size_t mSize{0};
+  std::size_t mCapacity{0};
+};
+} // namespace alihan
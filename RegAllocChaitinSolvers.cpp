@@ -4,39 +4,552 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <numeric>
 #include <optional>
 #include <queue>
 #include <vector>
 
 namespace {
+// Marks color as used in usedColors, together with the colors aliasing it.
+void markColorUsed(const alihan::InterferenceGraph &graph, unsigned color,
+                   std::vector<std::uint64_t> &usedColors) {
+  if (auto aliasRange = graph.getColorAliasRange(color)) {
+    std::size_t word{0};
+    for (std::uint64_t aliases : *aliasRange) {
+      if (word == usedColors.size()) {
+        break;
+      }
+      usedColors[word++] |= aliases;
+    }
+  } else if (color / 64 < usedColors.size()) {
+    usedColors[color / 64] |= std::uint64_t{1} << (color % 64);
+  }
+}
+
+// Returns the lowest color that is neither forbidden for node nor used by an
+// already colored neighbour of it or aliasing such a color. usedColors is
+// scratch space owned by the caller so that coloring a node does not allocate;
+// it is treated as a bitset of 64 bit words.
 auto findUnusedColor(const alihan::InterferenceGraph &graph,
                      std::size_t numberOfColors,
-                     const alihan::SolutionMap &solution,
-                     unsigned node) -> std::optional<unsigned> {
-  std::vector<char> colorUsage(numberOfColors);
-  if (auto edgeRangeOpt = graph.getEdgeRange(node)) {
-    for (unsigned edge : *edgeRangeOpt) {
-      auto it = solution.find(edge);
-      if (it != solution.end()) {
-        colorUsage[it->second] = true;
+                     const alihan::SolutionMap &solution, unsigned node,
+                     std::vector<std::uint64_t> &usedColors)
+    -> std::optional<unsigned> {
+  if (!graph.hasNode(node)) {
+    return {};
+  }
+
+  usedColors.assign((numberOfColors + 63) / 64, 0);
+  std::size_t word{0};
+  for (std::uint64_t forbidden : graph.getForbiddenColorRange(node)) {
+    if (word == usedColors.size()) {
+      break;
+    }
+    usedColors[word++] = forbidden;
+  }
+  for (unsigned edge : graph.getEdgeRange(node)) {
+    unsigned color{solution[edge]};
+    if (color != alihan::NoColor) {
+      markColorUsed(graph, color, usedColors);
+    }
+  }
+
+  for (word = 0; word != usedColors.size(); ++word) {
+    if (std::uint64_t freeColors = ~usedColors[word]) {
+      std::size_t color{word * 64 + __builtin_ctzll(freeColors)};
+      if (color < numberOfColors) {
+        return color;
       }
+      break;
     }
-  } else {
+  }
+  return {};
+}
+
+// Picks the color of the most frequently copied move partner of node if it is
+// still free. usedColors must hold the colors findUnusedColor just saw taken.
+auto findMoveColor(const alihan::InterferenceGraph &graph,
+                   std::size_t numberOfColors,
+                   const alihan::SolutionMap &solution, unsigned node,
+                   const std::vector<std::uint64_t> &usedColors)
+    -> std::optional<unsigned> {
+  std::optional<unsigned> bestColor;
+  double bestWeight{0};
+  for (const alihan::InterferenceGraph::Move &move :
+       graph.getMoveRange(node)) {
+    unsigned color{solution[move.node]};
+    if (color == alihan::NoColor || color >= numberOfColors ||
+        ((usedColors[color / 64] >> (color % 64)) & 1)) {
+      continue;
+    }
+    if (!bestColor || move.weight > bestWeight) {
+      bestColor = color;
+      bestWeight = move.weight;
+    }
+  }
+  return bestColor;
+}
+
+// Simplify worklists for solveChaitin. The graph itself is never modified:
+// removed nodes are only flagged and the remaining degree of every node is
+// tracked on the side, starting from InterferenceGraph::getDegree. Removing a
+// neighbour lowers it by the squeeze of that neighbour. Nodes with a degree
+// below numberOfColors wait in a plain worklist; the rest sit in a heap ordered
+// by spill cost. Removing a node only revisits its neighbours, so the heap is
+// updated lazily: every degree change pushes a fresh entry and entries whose
+// degree is out of date are dropped when they surface.
+class SimplifyWorklists {
+public:
+  SimplifyWorklists(const alihan::InterferenceGraph &graph,
+                    std::size_t numberOfColors,
+                    const alihan::SpillCost &spillCost);
+
+  [[nodiscard]] auto isEmpty() const -> bool;
+  [[nodiscard]] auto popLowDegree() -> std::optional<unsigned>;
+  [[nodiscard]] auto popSpillCandidate() -> unsigned;
+  void removeNode(unsigned node);
+
+private:
+  struct SpillCandidate {
+    unsigned node;
+    std::size_t degree;
+    double cost;
+    bool spillable;
+  };
+
+  struct IsMoreExpensive {
+    auto operator()(const SpillCandidate &c1,
+                    const SpillCandidate &c2) const -> bool;
+  };
+
+  void pushNode(unsigned node);
+
+  const alihan::InterferenceGraph &mGraph;
+  std::size_t mNumberOfColors;
+  const alihan::SpillCost &mSpillCost;
+  std::size_t mRemaining;
+  std::vector<std::size_t> mDegrees;
+  std::vector<char> mRemoved;
+  std::vector<unsigned> mLowDegree;
+  std::priority_queue<SpillCandidate, std::vector<SpillCandidate>,
+                      IsMoreExpensive>
+      mHighDegree;
+};
+
+SimplifyWorklists::SimplifyWorklists(const alihan::InterferenceGraph &graph,
+                                     std::size_t numberOfColors,
+                                     const alihan::SpillCost &spillCost)
+    : mGraph{graph}, mNumberOfColors{numberOfColors}, mSpillCost{spillCost},
+      mRemaining{graph.getSize()}, mDegrees(graph.getNodeIdLast()),
+      mRemoved(graph.getNodeIdLast()) {
+  for (unsigned node : mGraph.getNodeRange()) {
+    mDegrees[node] = mGraph.getDegree(node).value();
+    pushNode(node);
+  }
+}
+
+auto SimplifyWorklists::isEmpty() const -> bool { return mRemaining == 0; }
+
+auto SimplifyWorklists::popLowDegree() -> std::optional<unsigned> {
+  if (mLowDegree.empty()) {
     return {};
   }
+  unsigned node{mLowDegree.back()};
+  mLowDegree.pop_back();
+  return node;
+}
 
-  for (std::size_t color{0}; color != numberOfColors; ++color) {
-    if (!colorUsage[color]) {
-      return color;
+auto SimplifyWorklists::popSpillCandidate() -> unsigned {
+  while (true) {
+    SpillCandidate candidate = mHighDegree.top();
+    mHighDegree.pop();
+    if (!mRemoved[candidate.node] &&
+        mDegrees[candidate.node] == candidate.degree) {
+      return candidate.node;
     }
   }
-  return {};
+}
+
+void SimplifyWorklists::removeNode(unsigned node) {
+  mRemoved[node] = true;
+  --mRemaining;
+  for (unsigned neighbour : mGraph.getEdgeRange(node)) {
+    if (mRemoved[neighbour]) {
+      continue;
+    }
+    std::size_t squeeze{mGraph.getSqueeze(neighbour, node).value()};
+    std::size_t degree{mDegrees[neighbour]};
+    mDegrees[neighbour] -= squeeze;
+    if (squeeze && degree >= mNumberOfColors) {
+      pushNode(neighbour);
+    }
+  }
+}
+
+auto SimplifyWorklists::IsMoreExpensive::operator()(
+    const SpillCandidate &c1, const SpillCandidate &c2) const -> bool {
+  if (c1.spillable && c2.spillable) {
+    return c1.cost > c2.cost;
+  } else if (!c1.spillable && !c2.spillable) {
+    return c1.degree < c2.degree;
+  } else {
+    return c2.spillable;
+  }
+}
+
+void SimplifyWorklists::pushNode(unsigned node) {
+  std::size_t degree{mDegrees[node]};
+  if (degree < mNumberOfColors) {
+    mLowDegree.push_back(node);
+  } else {
+    bool spillable{mGraph.getSpillable(node).value()};
+    mHighDegree.push(
+        {node, degree, spillable ? mSpillCost(mGraph, node, degree) : 0.0,
+         spillable});
+  }
+}
+// Shared body of solveChaitin and solveOptimistic. Without optimism a
+// potential spill is dropped right away and never colored; with it, it is
+// pushed like any other node and select decides.
+auto simplifyAndSelect(const alihan::InterferenceGraph &graph,
+                       std::size_t numberOfColors, bool optimistic,
+                       const alihan::SpillCost &spillCost,
+                       alihan::SolverStats &stats)
+    -> alihan::SolutionMap {
+  SimplifyWorklists worklists(graph, numberOfColors, spillCost);
+
+  std::vector<unsigned> stack;
+  std::vector<char> isPotentialSpill(graph.getNodeIdLast());
+  while (!worklists.isEmpty()) {
+    ++stats.simplifySteps;
+    if (std::optional<unsigned> node = worklists.popLowDegree()) {
+      stack.push_back(*node);
+      worklists.removeNode(*node);
+    } else {
+      unsigned spill{worklists.popSpillCandidate()};
+      ++stats.potentialSpills;
+      if (optimistic) {
+        stack.push_back(spill);
+        isPotentialSpill[spill] = true;
+      }
+      worklists.removeNode(spill);
+    }
+  }
+
+  // Only nodes popped so far are in the solution, so looking at the colors of
+  // all neighbours in the original graph sees exactly the colored ones. A node
+  // pushed with a degree below numberOfColors always finds one.
+  alihan::SolutionMap solution(graph.getNodeIdLast(), alihan::NoColor);
+  std::vector<std::uint64_t> usedColors;
+  while (!stack.empty()) {
+    unsigned node = stack.back();
+    stack.pop_back();
+    std::optional<unsigned> color =
+        findUnusedColor(graph, numberOfColors, solution, node, usedColors);
+    if (color) {
+      if (std::optional<unsigned> moveColor = findMoveColor(
+              graph, numberOfColors, solution, node, usedColors)) {
+        color = moveColor;
+      }
+      solution[node] = *color;
+      stats.optimisticColored += isPotentialSpill[node];
+    }
+  }
+  return solution;
+}
+
+// Conservative coalescing ahead of simplify. Moves are visited from the most
+// to the least frequent, and the two ends of a move are merged if they do not
+// interfere and either the Briggs test (the merged node has fewer than
+// numberOfColors neighbours of significant degree) or the George test (every
+// neighbour of one end is insignificant or already a neighbour of the other)
+// passes. Neither test can turn a colorable graph into an uncolorable one.
+// Moves that fail are frozen: they stay in the coalesced graph only as a hint
+// for select. Forbidden colors act as neighbours of infinite degree. With
+// aliased colors a neighbour counts with its squeeze instead of once.
+class Coalescer {
+public:
+  Coalescer(const alihan::InterferenceGraph &graph,
+            std::size_t numberOfColors);
+
+  void coalesce(alihan::SolverStats &stats);
+  [[nodiscard]] auto getAlias(unsigned node) -> unsigned;
+  [[nodiscard]] auto createCoalescedGraph() -> alihan::InterferenceGraph;
+
+private:
+  [[nodiscard]] auto getDegree(unsigned node) const -> std::size_t;
+  [[nodiscard]] auto interferes(unsigned node1, unsigned node2) const -> bool;
+  [[nodiscard]] auto isBriggsSafe(unsigned node1, unsigned node2) -> bool;
+  [[nodiscard]] auto isGeorgeSafe(unsigned from, unsigned into) -> bool;
+  void merge(unsigned from, unsigned into);
+  void markNeighbours(unsigned node);
+  [[nodiscard]] auto getSqueeze(const std::uint64_t *forbidden,
+                                unsigned neighbour) const -> std::size_t;
+  [[nodiscard]] auto forbiddenWords(unsigned node) -> std::uint64_t *;
+  [[nodiscard]] auto forbiddenWords(unsigned node) const
+      -> const std::uint64_t *;
+
+  const alihan::InterferenceGraph &mGraph;
+  std::size_t mNumberOfColors;
+  std::size_t mColorWordCount;
+  std::vector<unsigned> mAliases;
+  std::vector<std::vector<unsigned>> mAdjacency;
+  std::vector<std::uint64_t> mForbiddenColors;
+  std::vector<std::size_t> mForbiddenColorCounts;
+  // Forbidden colors of two nodes merged, for isBriggsSafe.
+  std::vector<std::uint64_t> mMergedForbidden;
+  std::vector<double> mWeights;
+  std::vector<char> mSpillables;
+  std::vector<char> mRematerializables;
+  // mMarks[n] == mEpoch flags n as a neighbour of the node marked last.
+  std::vector<unsigned> mMarks;
+  unsigned mEpoch{0};
+};
+
+Coalescer::Coalescer(const alihan::InterferenceGraph &graph,
+                     std::size_t numberOfColors)
+    : mGraph{graph}, mNumberOfColors{numberOfColors},
+      mColorWordCount{(graph.getNumberOfColors() + 63) / 64},
+      mAliases(graph.getNodeIdLast()), mAdjacency(graph.getNodeIdLast()),
+      mForbiddenColors(graph.getNodeIdLast() * mColorWordCount),
+      mForbiddenColorCounts(graph.getNodeIdLast()),
+      mMergedForbidden(mColorWordCount), mWeights(graph.getNodeIdLast()),
+      mSpillables(graph.getNodeIdLast()),
+      mRematerializables(graph.getNodeIdLast()),
+      mMarks(graph.getNodeIdLast()) {
+  for (unsigned node : mGraph.getNodeRange()) {
+    mAliases[node] = node;
+    auto edgeRange = mGraph.getEdgeRange(node);
+    mAdjacency[node].assign(edgeRange.begin(), edgeRange.end());
+    auto forbiddenRange = mGraph.getForbiddenColorRange(node);
+    std::copy(forbiddenRange.begin(), forbiddenRange.end(),
+              forbiddenWords(node));
+    mForbiddenColorCounts[node] = mGraph.getForbiddenColorCount(node).value();
+    mWeights[node] = mGraph.getWeight(node).value();
+    mSpillables[node] = mGraph.getSpillable(node).value();
+    mRematerializables[node] = mGraph.getRematerializable(node).value();
+  }
+}
+
+void Coalescer::coalesce(alihan::SolverStats &stats) {
+  struct WeightedMove {
+    unsigned node1;
+    unsigned node2;
+    double weight;
+  };
+  std::vector<WeightedMove> moves;
+  for (unsigned node : mGraph.getNodeRange()) {
+    for (const alihan::InterferenceGraph::Move &move :
+         mGraph.getMoveRange(node)) {
+      if (node < move.node) {
+        moves.push_back({node, move.node, move.weight});
+      }
+    }
+  }
+  std::stable_sort(moves.begin(), moves.end(),
+                   [](const WeightedMove &m1, const WeightedMove &m2) {
+                     return m1.weight > m2.weight;
+                   });
+
+  for (const WeightedMove &move : moves) {
+    unsigned node1{getAlias(move.node1)};
+    unsigned node2{getAlias(move.node2)};
+    if (node1 == node2) {
+      continue;
+    }
+    if (interferes(node1, node2)) {
+      ++stats.constrainedMoves;
+    } else if (isBriggsSafe(node1, node2) || isGeorgeSafe(node2, node1)) {
+      merge(node2, node1);
+      ++stats.coalescedMoves;
+    } else if (isGeorgeSafe(node1, node2)) {
+      merge(node1, node2);
+      ++stats.coalescedMoves;
+    } else {
+      ++stats.frozenMoves;
+    }
+  }
+}
+
+auto Coalescer::getAlias(unsigned node) -> unsigned {
+  while (mAliases[node] != node) {
+    mAliases[node] = mAliases[mAliases[node]];
+    node = mAliases[node];
+  }
+  return node;
+}
+
+// Every alias becomes one node keeping the id of its representative, and the
+// frozen moves become moves between representatives.
+auto Coalescer::createCoalescedGraph() -> alihan::InterferenceGraph {
+  alihan::InterferenceGraph graph(mGraph.getNumberOfColors(),
+                                  mGraph.getMemoryResource());
+  for (unsigned color{0}; color != mGraph.getNumberOfColors(); ++color) {
+    if (auto aliasRange = mGraph.getColorAliasRange(color)) {
+      unsigned alias{0};
+      for (std::uint64_t aliases : *aliasRange) {
+        for (; aliases; aliases &= aliases - 1) {
+          graph.aliasColors(color, alias + __builtin_ctzll(aliases));
+        }
+        alias += 64;
+      }
+    }
+  }
+  for (unsigned node : mGraph.getNodeRange()) {
+    if (getAlias(node) == node) {
+      graph.addNode(node, mWeights[node], mSpillables[node],
+                    mRematerializables[node]);
+      for (unsigned color{0}; color != mGraph.getNumberOfColors(); ++color) {
+        if ((forbiddenWords(node)[color / 64] >> (color % 64)) & 1) {
+          graph.forbidColor(node, color);
+        }
+      }
+    }
+  }
+  for (unsigned node : mGraph.getNodeRange()) {
+    for (unsigned neighbour : mAdjacency[node]) {
+      if (node < neighbour) {
+        graph.addEdge(node, neighbour);
+      }
+    }
+    for (const alihan::InterferenceGraph::Move &move :
+         mGraph.getMoveRange(node)) {
+      unsigned alias1{getAlias(node)};
+      unsigned alias2{getAlias(move.node)};
+      if (node < move.node && alias1 != alias2 &&
+          !graph.hasEdge(alias1, alias2)) {
+        graph.addMove(alias1, alias2, move.weight);
+      }
+    }
+  }
+  return graph;
+}
+
+auto Coalescer::getDegree(unsigned node) const -> std::size_t {
+  if (!mGraph.hasColorAliases()) {
+    return mAdjacency[node].size() + mForbiddenColorCounts[node];
+  }
+  std::size_t degree{mForbiddenColorCounts[node]};
+  for (unsigned neighbour : mAdjacency[node]) {
+    degree += getSqueeze(forbiddenWords(node), neighbour);
+  }
+  return degree;
+}
+
+auto Coalescer::interferes(unsigned node1, unsigned node2) const -> bool {
+  const std::vector<unsigned> &adjacency1 = mAdjacency[node1];
+  const std::vector<unsigned> &adjacency2 = mAdjacency[node2];
+  if (adjacency1.size() <= adjacency2.size()) {
+    return std::find(adjacency1.begin(), adjacency1.end(), node2) !=
+           adjacency1.end();
+  }
+  return std::find(adjacency2.begin(), adjacency2.end(), node1) !=
+         adjacency2.end();
+}
+
+auto Coalescer::isBriggsSafe(unsigned node1, unsigned node2) -> bool {
+  std::size_t significant{0};
+  std::uint64_t *forbidden1 = forbiddenWords(node1);
+  std::uint64_t *forbidden2 = forbiddenWords(node2);
+  for (std::size_t word{0}; word != mColorWordCount; ++word) {
+    mMergedForbidden[word] = forbidden1[word] | forbidden2[word];
+    significant += __builtin_popcountll(mMergedForbidden[word]);
+  }
+
+  // A neighbour of both ends loses the squeeze of one of them when they are
+  // merged.
+  markNeighbours(node1);
+  for (unsigned neighbour : mAdjacency[node2]) {
+    bool isShared{mMarks[neighbour] == mEpoch};
+    std::size_t lost{
+        isShared ? getSqueeze(forbiddenWords(neighbour), node2) : 0};
+    if (getDegree(neighbour) - lost >= mNumberOfColors) {
+      significant += getSqueeze(mMergedForbidden.data(), neighbour);
+    }
+    if (isShared) {
+      mMarks[neighbour] = 0;
+    }
+  }
+  for (unsigned neighbour : mAdjacency[node1]) {
+    if (mMarks[neighbour] == mEpoch &&
+        getDegree(neighbour) >= mNumberOfColors) {
+      significant += getSqueeze(mMergedForbidden.data(), neighbour);
+    }
+  }
+  return significant < mNumberOfColors;
+}
+
+auto Coalescer::isGeorgeSafe(unsigned from, unsigned into) -> bool {
+  std::uint64_t *forbiddenFrom = forbiddenWords(from);
+  std::uint64_t *forbiddenInto = forbiddenWords(into);
+  for (std::size_t word{0}; word != mColorWordCount; ++word) {
+    if (forbiddenFrom[word] & ~forbiddenInto[word]) {
+      return false;
+    }
+  }
+
+  markNeighbours(into);
+  return std::all_of(mAdjacency[from].begin(), mAdjacency[from].end(),
+                     [&](unsigned neighbour) {
+                       return getDegree(neighbour) < mNumberOfColors ||
+                              mMarks[neighbour] == mEpoch;
+                     });
+}
+
+void Coalescer::merge(unsigned from, unsigned into) {
+  mAliases[from] = into;
+  markNeighbours(into);
+  for (unsigned neighbour : mAdjacency[from]) {
+    std::vector<unsigned> &adjacency = mAdjacency[neighbour];
+    *std::find(adjacency.begin(), adjacency.end(), from) = adjacency.back();
+    adjacency.pop_back();
+    if (mMarks[neighbour] != mEpoch) {
+      adjacency.push_back(into);
+      mAdjacency[into].push_back(neighbour);
+    }
+  }
+  mAdjacency[from].clear();
+  mAdjacency[from].shrink_to_fit();
+
+  std::uint64_t *forbiddenFrom = forbiddenWords(from);
+  std::uint64_t *forbiddenInto = forbiddenWords(into);
+  std::size_t forbiddenCount{0};
+  for (std::size_t word{0}; word != mColorWordCount; ++word) {
+    forbiddenInto[word] |= forbiddenFrom[word];
+    forbiddenCount += __builtin_popcountll(forbiddenInto[word]);
+  }
+  mForbiddenColorCounts[into] = forbiddenCount;
+  mWeights[into] += mWeights[from];
+  mSpillables[into] = mSpillables[into] && mSpillables[from];
+  mRematerializables[into] =
+      mRematerializables[into] && mRematerializables[from];
+}
+
+void Coalescer::markNeighbours(unsigned node) {
+  ++mEpoch;
+  for (unsigned neighbour : mAdjacency[node]) {
+    mMarks[neighbour] = mEpoch;
+  }
+}
+
+auto Coalescer::getSqueeze(const std::uint64_t *forbidden,
+                           unsigned neighbour) const -> std::size_t {
+  return mGraph.getSqueeze(forbidden, forbiddenWords(neighbour));
+}
+
+auto Coalescer::forbiddenWords(unsigned node) -> std::uint64_t * {
+  return mForbiddenColors.data() + node * mColorWordCount;
+}
+
+auto Coalescer::forbiddenWords(unsigned node) const -> const std::uint64_t * {
+  return mForbiddenColors.data() + node * mColorWordCount;
 }
 } // namespace
 
 namespace alihan {
-auto solveGreedy(const InterferenceGraph &graph,
-                 std::size_t numberOfColors) -> SolutionMap {
+auto solveGreedy(const InterferenceGraph &graph, std::size_t numberOfColors,
+                 SolverStats & /*stats*/) -> SolutionMap {
   auto comp = [&](unsigned const &virt1, unsigned const &virt2) {
     return graph.isNodeLessThan(virt1, virt2).value();
   };
@@ -48,81 +561,129 @@ auto solveGreedy(const InterferenceGraph &graph,
     virts.push(node);
   }
 
-  SolutionMap solution;
+  SolutionMap solution(graph.getNodeIdLast(), NoColor);
+  std::vector<std::uint64_t> usedColors;
 
   while (!virts.empty()) {
     unsigned virt = virts.top();
     virts.pop();
 
     std::optional<unsigned> color =
-        findUnusedColor(graph, numberOfColors, solution, virt);
+        findUnusedColor(graph, numberOfColors, solution, virt, usedColors);
     if (color.has_value()) {
-      solution.insert({virt, color.value()});
+      solution[virt] = color.value();
     }
   }
 
   return solution;
 }
 
-auto solveChaitin(const InterferenceGraph &graph,
-                  std::size_t numberOfColors) -> SolutionMap {
-  InterferenceGraph tempGraph = graph;
-
-  auto isLess = [&](unsigned node1, unsigned node2) {
-    double w1{tempGraph.getWeight(node1).value()};
-    double w2{tempGraph.getWeight(node2).value()};
-    std::size_t e1{tempGraph.getEdgeCount(node1).value()};
-    std::size_t e2{tempGraph.getEdgeCount(node2).value()};
-    bool s1{tempGraph.getSpillable(node1).value()};
-    bool s2{tempGraph.getSpillable(node2).value()};
-    if (s1 && s2) {
-      return w1 / e1 < w2 / e2;
-    } else if (!s1 && !s2) {
-      return e1 > e2;
-    } else {
-      return s1;
-    }
+auto spillCostByWeight(const InterferenceGraph &graph, unsigned node,
+                       std::size_t degree) -> double {
+  return graph.getWeight(node).value() / degree;
+}
+
+auto makeRematSpillCost(double rematScale) -> SpillCost {
+  return [rematScale](const InterferenceGraph &graph, unsigned node,
+                      std::size_t degree) {
+    double cost{spillCostByWeight(graph, node, degree)};
+    return graph.getRematerializable(node).value() ? cost * rematScale : cost;
   };
+}
 
-  std::vector<unsigned> stack;
-  while (!tempGraph.isEmpty()) {
-    std::optional<unsigned> max;
-    for (unsigned node : tempGraph.getNodeRange()) {
-      if (tempGraph.getEdgeCount(node).value() >= numberOfColors) {
-        continue;
-      }
+auto solveChaitin(const InterferenceGraph &graph, std::size_t numberOfColors,
+                  SolverStats &stats) -> SolutionMap {
+  return solveChaitin(graph, numberOfColors, spillCostByWeight, stats);
+}
 
-      if (!max || (max && isLess(*max, node))) {
-        max = node;
-      }
-    }
+auto solveChaitin(const InterferenceGraph &graph, std::size_t numberOfColors,
+                  const SpillCost &spillCost,
+                  SolverStats &stats) -> SolutionMap {
+  return simplifyAndSelect(graph, numberOfColors, false, spillCost, stats);
+}
 
-    if (max) {
-      stack.push_back(*max);
-      tempGraph.removeNode(*max);
-    } else {
-      auto nodeRange = tempGraph.getNodeRange();
-      unsigned min =
-          *std::min_element(nodeRange.begin(), nodeRange.end(), isLess);
-      tempGraph.removeNode(min);
-    }
+auto solveOptimistic(const InterferenceGraph &graph,
+                     std::size_t numberOfColors,
+                     SolverStats &stats) -> SolutionMap {
+  return solveOptimistic(graph, numberOfColors, spillCostByWeight, stats);
+}
+
+auto solveOptimistic(const InterferenceGraph &graph,
+                     std::size_t numberOfColors, const SpillCost &spillCost,
+                     SolverStats &stats) -> SolutionMap {
+  return simplifyAndSelect(graph, numberOfColors, true, spillCost, stats);
+}
+
+auto solveCoalescing(const InterferenceGraph &graph,
+                     std::size_t numberOfColors,
+                     SolverStats &stats) -> SolutionMap {
+  return solveCoalescing(graph, numberOfColors, spillCostByWeight, stats);
+}
+
+auto solveCoalescing(const InterferenceGraph &graph,
+                     std::size_t numberOfColors, const SpillCost &spillCost,
+                     SolverStats &stats) -> SolutionMap {
+  Coalescer coalescer(graph, numberOfColors);
+  coalescer.coalesce(stats);
+  SolutionMap coalescedSolution = simplifyAndSelect(
+      coalescer.createCoalescedGraph(), numberOfColors, true, spillCost, stats);
+
+  SolutionMap solution(graph.getNodeIdLast(), NoColor);
+  for (unsigned node : graph.getNodeRange()) {
+    solution[node] = coalescedSolution[coalescer.getAlias(node)];
   }
+  return solution;
+}
 
-  SolutionMap solution;
+// Colors a problem for which Registers::isTriviallyColorable holds without
+// building a graph: each virtual register takes the first candidate group none
+// of its neighbours has taken or aliases yet, preferring the group of a move
+// partner.
+auto solveTrivially(const Registers &registers) -> SolutionMap {
+  std::vector<unsigned> order(registers.getVirtCount());
+  std::iota(order.begin(), order.end(), 0u);
+  return solveInOrder(registers, order);
+}
 
-  while (!stack.empty()) {
-    unsigned node = stack.back();
-    stack.pop_back();
-    tempGraph.addNode(node, 0.0, true);
-    auto range = graph.getEdgeRange(node);
-    for (unsigned edge : *range) {
-      if (tempGraph.hasNode(edge)) {
-        tempGraph.addEdge(node, edge);
+auto solveInOrder(const Registers &registers,
+                  const std::vector<unsigned> &order) -> SolutionMap {
+  SolutionMap solution(registers.getVirtOrdinalIdLast(), NoColor);
+
+  std::vector<char> isGroupTaken(registers.getGroupCount());
+  unsigned virtOrdinalIdFirst{registers.getVirtOrdinalIdFirst()};
+  for (unsigned index : order) {
+    unsigned virt{virtOrdinalIdFirst + index};
+    const Registers::VirtualRegister *virtReg =
+        registers.getVirtRegByOrdinal(virt);
+    std::fill(isGroupTaken.begin(), isGroupTaken.end(), false);
+    for (unsigned interference : virtReg->interferences) {
+      unsigned color{solution[virtOrdinalIdFirst + interference]};
+      if (color != NoColor) {
+        for (unsigned alias : registers.getGroupAliases(color)) {
+          isGroupTaken[alias] = true;
+        }
+      }
+    }
+    double moveWeight{0};
+    for (const Registers::Move &move : virtReg->moves) {
+      unsigned color{solution[virtOrdinalIdFirst + move.virtIndex]};
+      if (color != NoColor && !isGroupTaken[color] &&
+          virtReg->hasCandidateGroup(color) &&
+          (solution[virt] == NoColor || move.weight > moveWeight)) {
+        solution[virt] = color;
+        moveWeight = move.weight;
+      }
+    }
+    if (solution[virt] != NoColor) {
+      continue;
+    }
+    for (unsigned candPhysId : virtReg->candidatePhysRegs) {
+      unsigned group{registers.getPhysGroupId(candPhysId).value()};
+      if (!isGroupTaken[group]) {
+        solution[virt] = group;
+        break;
       }
     }
-    unsigned color =
-        findUnusedColor(tempGraph, numberOfColors, solution, node).value();
-    solution.insert({node, color});
   }
   return solution;
 }
@@ -3,9 +3,83 @@
 #include "RegAllocChaitinGraph.h"
 #include "RegAllocChaitinRegisters.h"
 
+#include <cstddef>
+#include <functional>
+#include <vector>
+
 namespace alihan {
+// Counters the solvers add to, so one instance can accumulate several runs.
+struct SolverStats {
+  // Nodes simplify had to remove while every remaining node had a degree of
+  // at least numberOfColors.
+  std::size_t potentialSpills{0};
+  // Nodes removed from the graph by simplify, potential spills included.
+  std::size_t simplifySteps{0};
+  // Potential spills that select still found a color for.
+  std::size_t optimisticColored{0};
+  // Moves whose ends were merged by solveCoalescing, those that were given up
+  // on as not safe to merge, and those whose ends interfere.
+  std::size_t coalescedMoves{0};
+  std::size_t frozenMoves{0};
+  std::size_t constrainedMoves{0};
+};
+
+// Cost of spilling a spillable node that simplify finds with the given
+// degree. When every remaining node has a degree of at least numberOfColors,
+// the one with the lowest cost is removed as a potential spill.
+using SpillCost = std::function<double(const InterferenceGraph &graph,
+                                        unsigned node, std::size_t degree)>;
+
+// Chaitin's cost: the weight of the node divided by its degree.
+[[nodiscard]] auto spillCostByWeight(const InterferenceGraph &graph,
+                                     unsigned node, std::size_t degree)
+    -> double;
+// Spilling a rematerializable node needs no stores and turns its reloads into
+// recomputations. The returned cost is spillCostByWeight, scaled by
+// rematScale for rematerializable nodes, so a scale below 1 spills them first.
+inline constexpr double DefaultRematSpillCostScale{0.5};
+[[nodiscard]] auto makeRematSpillCost(double rematScale) -> SpillCost;
+
 [[nodiscard]] auto solveGreedy(const InterferenceGraph &graph,
-                               std::size_t numberOfColors) -> SolutionMap;
+                               std::size_t numberOfColors,
+                               SolverStats &stats) -> SolutionMap;
+// The simplify based solvers below rank potential spills by spillCost, or by
+// spillCostByWeight if none is given.
+[[nodiscard]] auto solveChaitin(const InterferenceGraph &graph,
+                                std::size_t numberOfColors,
+                                SolverStats &stats) -> SolutionMap;
 [[nodiscard]] auto solveChaitin(const InterferenceGraph &graph,
-                                std::size_t numberOfColors) -> SolutionMap;
+                                std::size_t numberOfColors,
+                                const SpillCost &spillCost,
+                                SolverStats &stats) -> SolutionMap;
+// Briggs' optimistic variant of solveChaitin: potential spills are pushed on
+// the stack too and only left uncolored if select finds no free color.
+[[nodiscard]] auto solveOptimistic(const InterferenceGraph &graph,
+                                   std::size_t numberOfColors,
+                                   SolverStats &stats) -> SolutionMap;
+[[nodiscard]] auto solveOptimistic(const InterferenceGraph &graph,
+                                   std::size_t numberOfColors,
+                                   const SpillCost &spillCost,
+                                   SolverStats &stats) -> SolutionMap;
+// solveOptimistic after conservatively coalescing move related nodes, see
+// Coalescer. Coalesced nodes always get the same color, and a coalesced node
+// is only rematerializable if all of its nodes are.
+[[nodiscard]] auto solveCoalescing(const InterferenceGraph &graph,
+                                   std::size_t numberOfColors,
+                                   SolverStats &stats) -> SolutionMap;
+[[nodiscard]] auto solveCoalescing(const InterferenceGraph &graph,
+                                   std::size_t numberOfColors,
+                                   const SpillCost &spillCost,
+                                   SolverStats &stats) -> SolutionMap;
+[[nodiscard]] auto solveTrivially(const Registers &registers) -> SolutionMap;
+// Colors the virtual registers one at a time in the given order of ordinal
+// indices, each with a color its copies have or else its first free
+// candidate, and without building a graph. Registers it finds no color for
+// are left uncolored. Given the registers in the order their live ranges
+// start, this is a linear scan. It colors an interval graph with as many colors
+// as there are registers live at once, as long as every register may take
+// every color.
+[[nodiscard]] auto solveInOrder(const Registers &registers,
+                                const std::vector<unsigned> &order)
+    -> SolutionMap;
 } // namespace alihan
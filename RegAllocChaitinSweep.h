@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace alihan {
+template <typename Index> struct Segment {
+  Index start;
+  Index end;
+  unsigned owner;
+};
+
+// Calls callback(owner1, owner2) for every pair of distinct owners that have
+// overlapping half-open [start, end) segments. Segments are swept in start
+// order while keeping only the still live ones in an active set, a min-heap on
+// the end, so every segment is looked at once more when it retires and the
+// cost is O(n log n) in the number of segments plus the number of overlaps
+// instead of the number of owner pairs. A pair is reported once per overlapping
+// segment pair, so callers must tolerate duplicates. The active set uses the
+// allocator of segments.
+template <typename Index, typename Allocator, typename Callback>
+void forEachOverlap(std::vector<Segment<Index>, Allocator> segments,
+                    Callback callback) {
+  std::sort(segments.begin(), segments.end(),
+            [](const Segment<Index> &s1, const Segment<Index> &s2) {
+              return s1.start < s2.start;
+            });
+
+  auto endsLater = [](const Segment<Index> &s1, const Segment<Index> &s2) {
+    return s2.end < s1.end;
+  };
+  std::vector<Segment<Index>, Allocator> active(segments.get_allocator());
+  for (const Segment<Index> &segment : segments) {
+    while (!active.empty() && !(segment.start < active.front().end)) {
+      std::pop_heap(active.begin(), active.end(), endsLater);
+      active.pop_back();
+    }
+    for (const Segment<Index> &activeSegment : active) {
+      if (activeSegment.owner != segment.owner) {
+        callback(activeSegment.owner, segment.owner);
+      }
+    }
+    active.push_back(segment);
+    std::push_heap(active.begin(), active.end(), endsLater);
+  }
+}
+
+// Sorts segments by start and returns the largest number of them live at the
+// same point, counting half-open [start, end) segments like forEachOverlap.
+// Afterwards owners appear in segments in the order they first become live.
+template <typename Index, typename Allocator>
+auto sortAndCountMaxOverlap(std::vector<Segment<Index>, Allocator> &segments)
+    -> std::size_t {
+  std::sort(segments.begin(), segments.end(),
+            [](const Segment<Index> &s1, const Segment<Index> &s2) {
+              return s1.start < s2.start;
+            });
+
+  // Min-heap of the ends of the live segments.
+  auto later = [](const Index &end1, const Index &end2) { return end2 < end1; };
+  using EndAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Index>;
+  std::vector<Index, EndAllocator> ends(segments.get_allocator());
+  std::size_t maxOverlap{0};
+  for (const Segment<Index> &segment : segments) {
+    while (!ends.empty() && !(segment.start < ends.front())) {
+      std::pop_heap(ends.begin(), ends.end(), later);
+      ends.pop_back();
+    }
+    ends.push_back(segment.end);
+    std::push_heap(ends.begin(), ends.end(), later);
+    maxOverlap = std::max(maxOverlap, ends.size());
+  }
+  return maxOverlap;
+}
+} // namespace alihan
@@ -0,0 +1,129 @@
+// Compares the all-pairs overlap loop that assignRemainingIntervals used to run
+// against the sweep in RegAllocChaitinSweep.h on synthetic live intervals.
+//
+// Usage: chaitin-sweep-bench [seed]
+
+#include "RegAllocChaitinSweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+struct Interval {
+  std::vector<std::pair<unsigned, unsigned>> segments;
+};
+
+auto generateIntervals(std::size_t count, std::mt19937 &rng)
+    -> std::vector<Interval> {
+  // Keep the average number of simultaneously live intervals roughly constant
+  // as the function grows, like real code does.
+  unsigned span{static_cast<unsigned>(count) * 8};
+  std::uniform_int_distribution<unsigned> startDist(0, span);
+  std::uniform_int_distribution<unsigned> lengthDist(1, 48);
+  std::uniform_int_distribution<unsigned> gapDist(1, 64);
+  std::uniform_int_distribution<unsigned> segmentCountDist(1, 4);
+
+  std::vector<Interval> intervals(count);
+  for (Interval &interval : intervals) {
+    unsigned pos{startDist(rng)};
+    for (unsigned i{0}, e{segmentCountDist(rng)}; i != e; ++i) {
+      unsigned end{pos + lengthDist(rng)};
+      interval.segments.emplace_back(pos, end);
+      pos = end + gapDist(rng);
+    }
+  }
+  return intervals;
+}
+
+// Same walk as LiveRange::overlaps.
+auto overlaps(const Interval &i1, const Interval &i2) -> bool {
+  auto it1 = i1.segments.begin();
+  auto it2 = i2.segments.begin();
+  while (it1 != i1.segments.end() && it2 != i2.segments.end()) {
+    if (it1->first < it2->second && it2->first < it1->second) {
+      return true;
+    }
+    if (it1->second <= it2->second) {
+      ++it1;
+    } else {
+      ++it2;
+    }
+  }
+  return false;
+}
+
+auto normalize(std::vector<std::pair<unsigned, unsigned>> edges)
+    -> std::vector<std::pair<unsigned, unsigned>> {
+  for (auto &edge : edges) {
+    if (edge.first > edge.second) {
+      std::swap(edge.first, edge.second);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  return edges;
+}
+
+auto buildAllPairs(const std::vector<Interval> &intervals)
+    -> std::vector<std::pair<unsigned, unsigned>> {
+  std::vector<std::pair<unsigned, unsigned>> edges;
+  for (unsigned i{0}; i != intervals.size(); ++i) {
+    for (unsigned j{i + 1}; j != intervals.size(); ++j) {
+      if (overlaps(intervals[i], intervals[j])) {
+        edges.emplace_back(i, j);
+      }
+    }
+  }
+  return edges;
+}
+
+auto buildSweep(const std::vector<Interval> &intervals)
+    -> std::vector<std::pair<unsigned, unsigned>> {
+  std::vector<alihan::Segment<unsigned>> segments;
+  for (unsigned i{0}; i != intervals.size(); ++i) {
+    for (auto [start, end] : intervals[i].segments) {
+      segments.push_back({start, end, i});
+    }
+  }
+  std::vector<std::pair<unsigned, unsigned>> edges;
+  alihan::forEachOverlap(std::move(segments), [&](unsigned i, unsigned j) {
+    edges.emplace_back(i, j);
+  });
+  return edges;
+}
+
+template <typename Function>
+auto measure(Function function)
+    -> std::pair<double, std::vector<std::pair<unsigned, unsigned>>> {
+  auto start = std::chrono::steady_clock::now();
+  auto edges = function();
+  std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - start};
+  return {elapsed.count(), normalize(std::move(edges))};
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  std::mt19937 rng(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1);
+
+  std::cout << "intervals\tedges\tall-pairs ms\tsweep ms\n";
+  for (std::size_t count : {1000, 2000, 4000, 8000}) {
+    std::vector<Interval> intervals = generateIntervals(count, rng);
+    auto [allPairsTime, allPairsEdges] =
+        measure([&] { return buildAllPairs(intervals); });
+    auto [sweepTime, sweepEdges] = measure([&] { return buildSweep(intervals); });
+    if (allPairsEdges != sweepEdges) {
+      std::cerr << "edge sets differ for " << count << " intervals\n";
+      return 1;
+    }
+    std::cout << count << '\t' << sweepEdges.size() << '\t' << allPairsTime
+              << '\t' << sweepTime << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,219 @@
+// Replays allocation problems dumped with -chaitin-dump-dir on the solvers.
+// Every dump is split into subproblems the way the pass does it, and the time
+// and result of each solver are reported per dump. The -remat solvers rank
+// potential spills by makeRematSpillCost instead of spillCostByWeight, and are
+// run once for every scale given with --remat-scales (by default only
+// DefaultRematSpillCostScale), which the pass takes from
+// -chaitin-remat-spill-cost-scale.
+//
+// Usage: chaitin-replay-bench [--remat-scales=scale,...]
+//                             [greedy|chaitin|optimistic|coalescing|
+//                              chaitin-remat|optimistic-remat|
+//                              coalescing-remat|all] dump...
+
+#include "RegAllocChaitinGraph.h"
+#include "RegAllocChaitinRegisters.h"
+#include "RegAllocChaitinSerialization.h"
+#include "RegAllocChaitinSolvers.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+using Solver = alihan::SolutionMap (*)(const alihan::InterferenceGraph &,
+                                       std::size_t, const alihan::SpillCost &,
+                                       alihan::SolverStats &);
+
+struct SolverEntry {
+  const char *name;
+  Solver solver;
+  // Whether the solver ranks potential spills by makeRematSpillCost.
+  bool remat;
+};
+
+constexpr SolverEntry Solvers[]{
+    {"greedy",
+     [](const alihan::InterferenceGraph &graph, std::size_t numberOfColors,
+        const alihan::SpillCost &, alihan::SolverStats &stats) {
+       return alihan::solveGreedy(graph, numberOfColors, stats);
+     },
+     false},
+    {"chaitin", alihan::solveChaitin, false},
+    {"optimistic", alihan::solveOptimistic, false},
+    {"coalescing", alihan::solveCoalescing, false},
+    {"chaitin-remat", alihan::solveChaitin, true},
+    {"optimistic-remat", alihan::solveOptimistic, true},
+    {"coalescing-remat", alihan::solveCoalescing, true}};
+
+// Parses a comma separated list of non-negative scales.
+auto parseScales(const char *list) -> std::optional<std::vector<double>> {
+  std::vector<double> scales;
+  for (;;) {
+    char *end{nullptr};
+    double scale{std::strtod(list, &end)};
+    if (end == list || !(scale >= 0.0)) {
+      return {};
+    }
+    scales.push_back(scale);
+    if (*end == '\0') {
+      return scales;
+    }
+    if (*end != ',') {
+      return {};
+    }
+    list = end + 1;
+  }
+}
+
+auto load(const char *path) -> std::optional<alihan::Registers> {
+  int fd{open(path, O_RDONLY)};
+  if (fd < 0) {
+    return {};
+  }
+  struct stat status {};
+  std::optional<alihan::Registers> registers;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    void *data{mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+    if (data != MAP_FAILED) {
+      registers = alihan::deserializeRegisters(static_cast<const char *>(data),
+                                               status.st_size);
+      munmap(data, status.st_size);
+    }
+  }
+  close(fd);
+  return registers;
+}
+
+struct Result {
+  double milliseconds{0.0};
+  std::size_t uncolored{0};
+  // Uncolored registers that are rematerializable.
+  std::size_t uncoloredRemat{0};
+  double spillCost{0.0};
+};
+
+auto replay(const std::vector<alihan::Registers> &subproblems, Solver solver,
+            const alihan::SpillCost &spillCost) -> Result {
+  Result result;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<alihan::SolutionMap> solutions;
+  for (const alihan::Registers &subproblem : subproblems) {
+    alihan::SolverStats stats;
+    if (subproblem.isTriviallyColorable()) {
+      solutions.push_back(alihan::solveTrivially(subproblem));
+    } else {
+      solutions.push_back(solver(subproblem.createInterferenceGraph(),
+                                 subproblem.getGroupCount(), spillCost,
+                                 stats));
+    }
+  }
+  std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - start};
+  result.milliseconds = elapsed.count();
+
+  for (std::size_t i{0}; i != subproblems.size(); ++i) {
+    const alihan::Registers &subproblem = subproblems[i];
+    for (unsigned virt{subproblem.getVirtOrdinalIdFirst()},
+         e{subproblem.getVirtOrdinalIdLast()};
+         virt != e; ++virt) {
+      if (solutions[i][virt] == alihan::NoColor) {
+        const alihan::Registers::VirtualRegister *virtReg =
+            subproblem.getVirtRegByOrdinal(virt);
+        ++result.uncolored;
+        result.uncoloredRemat += virtReg->rematerializable;
+        result.spillCost += virtReg->weight;
+      }
+    }
+  }
+  return result;
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  constexpr std::size_t ScalesPrefixLength{sizeof("--remat-scales=") - 1};
+  std::vector<double> scales{alihan::DefaultRematSpillCostScale};
+  int first{1};
+  if (argc > 1 &&
+      std::strncmp(argv[1], "--remat-scales=", ScalesPrefixLength) == 0) {
+    std::optional<std::vector<double>> parsed =
+        parseScales(argv[1] + ScalesPrefixLength);
+    if (!parsed) {
+      std::cerr << "invalid scales " << argv[1] + ScalesPrefixLength << '\n';
+      return 1;
+    }
+    scales = std::move(*parsed);
+    ++first;
+  }
+  if (argc < first + 2) {
+    std::cerr << "usage: " << argv[0]
+              << " [--remat-scales=scale,...] "
+                 "greedy|chaitin|optimistic|coalescing|chaitin-remat|"
+                 "optimistic-remat|coalescing-remat|all dump...\n";
+    return 1;
+  }
+  std::vector<SolverEntry> solvers;
+  for (const SolverEntry &entry : Solvers) {
+    if (std::strcmp(argv[first], "all") == 0 ||
+        std::strcmp(argv[first], entry.name) == 0) {
+      solvers.push_back(entry);
+    }
+  }
+  if (solvers.empty()) {
+    std::cerr << "unknown solver " << argv[first] << '\n';
+    return 1;
+  }
+
+  std::cout << "dump\tvirtuals\tsubproblems\tsolver\tremat scale\tms"
+               "\tuncolored\tuncolored remat\tspill cost\n";
+  for (int arg{first + 1}; arg != argc; ++arg) {
+    std::optional<alihan::Registers> registers = load(argv[arg]);
+    if (!registers) {
+      std::cerr << argv[arg] << ": not a valid dump\n";
+      return 1;
+    }
+    std::vector<alihan::Registers> subproblems;
+    for (const alihan::Registers &partition : registers->partitionByGroups()) {
+      std::vector<alihan::Registers> components = partition.splitComponents();
+      std::move(components.begin(), components.end(),
+                std::back_inserter(subproblems));
+    }
+    auto report = [&](const char *name, std::optional<double> scale,
+                      Result result) {
+      std::cout << argv[arg] << '\t' << registers->getVirtCount() << '\t'
+                << subproblems.size() << '\t' << name << '\t';
+      if (scale) {
+        std::cout << *scale;
+      } else {
+        std::cout << '-';
+      }
+      std::cout << '\t' << result.milliseconds << '\t' << result.uncolored
+                << '\t' << result.uncoloredRemat << '\t' << result.spillCost
+                << '\n';
+    };
+    for (const SolverEntry &entry : solvers) {
+      if (!entry.remat) {
+        report(entry.name, std::nullopt,
+               replay(subproblems, entry.solver, alihan::spillCostByWeight));
+        continue;
+      }
+      for (double scale : scales) {
+        report(entry.name, scale,
+               replay(subproblems, entry.solver,
+                      alihan::makeRematSpillCost(scale)));
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,261 @@
+// Runs every graph solver on synthetic interference graphs and reports the
+// time, peak heap usage, colors used and spill cost of each.
+//
+// Three kinds of graphs are generated: uniformly random ones, interval graphs
+// like those of straight-line code, and chordal graphs like those of programs
+// in SSA form. Each also gets a few forbidden colors and move edges.
+//
+// Usage: chaitin-solver-bench [nodes [colors [seed]]]
+
+#include "RegAllocChaitinGraph.h"
+#include "RegAllocChaitinRegisters.h"
+#include "RegAllocChaitinSolvers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Heap usage is tracked by replacing the global allocation functions, so the
+// peak can be reset before every solver run.
+namespace {
+std::size_t currentBytes{0};
+std::size_t peakBytes{0};
+// Keeps the payload aligned for any fundamental type.
+constexpr std::size_t HeaderSize{alignof(std::max_align_t)};
+
+auto allocate(std::size_t size) -> void * {
+  auto *block = static_cast<char *>(std::malloc(size + HeaderSize));
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  *reinterpret_cast<std::size_t *>(block) = size;
+  currentBytes += size;
+  peakBytes = std::max(peakBytes, currentBytes);
+  return block + HeaderSize;
+}
+
+void deallocate(void *pointer) noexcept {
+  if (!pointer) {
+    return;
+  }
+  char *block = static_cast<char *>(pointer) - HeaderSize;
+  currentBytes -= *reinterpret_cast<std::size_t *>(block);
+  std::free(block);
+}
+} // namespace
+
+auto operator new(std::size_t size) -> void * { return allocate(size); }
+auto operator new[](std::size_t size) -> void * { return allocate(size); }
+void operator delete(void *pointer) noexcept { deallocate(pointer); }
+void operator delete[](void *pointer) noexcept { deallocate(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept {
+  deallocate(pointer);
+}
+void operator delete[](void *pointer, std::size_t) noexcept {
+  deallocate(pointer);
+}
+
+namespace {
+using Edges = std::vector<std::pair<unsigned, unsigned>>;
+
+// Roughly 2 * colors neighbours per node, so simplify regularly gets stuck.
+auto generateRandom(unsigned nodes, unsigned colors, std::mt19937 &rng)
+    -> Edges {
+  std::bernoulli_distribution hasEdge(
+      std::min(1.0, 2.0 * colors / std::max(nodes, 1u)));
+  Edges edges;
+  for (unsigned i{0}; i != nodes; ++i) {
+    for (unsigned j{i + 1}; j != nodes; ++j) {
+      if (hasEdge(rng)) {
+        edges.emplace_back(i, j);
+      }
+    }
+  }
+  return edges;
+}
+
+// Intervals on a line with about colors + colors / 4 of them live at any
+// point, so some have to be spilled.
+auto generateInterval(unsigned nodes, unsigned colors, std::mt19937 &rng)
+    -> Edges {
+  unsigned span{nodes * 4};
+  unsigned averageLength{std::max(1u, span * (colors + colors / 4) / nodes)};
+  std::uniform_int_distribution<unsigned> startDist(0, span);
+  std::uniform_int_distribution<unsigned> lengthDist(1, 2 * averageLength);
+
+  std::vector<std::pair<unsigned, unsigned>> intervals(nodes);
+  for (auto &interval : intervals) {
+    interval.first = startDist(rng);
+    interval.second = interval.first + lengthDist(rng);
+  }
+  Edges edges;
+  for (unsigned i{0}; i != nodes; ++i) {
+    for (unsigned j{i + 1}; j != nodes; ++j) {
+      if (intervals[i].first < intervals[j].second &&
+          intervals[j].first < intervals[i].second) {
+        edges.emplace_back(i, j);
+      }
+    }
+  }
+  return edges;
+}
+
+// Every new node is joined to a random subset of a clique made of an existing
+// node and its earlier neighbours. Reversing the insertion order gives a
+// perfect elimination order, so the graph is chordal. Cliques grow up to
+// colors + colors / 4 nodes.
+auto generateChordal(unsigned nodes, unsigned colors, std::mt19937 &rng)
+    -> Edges {
+  unsigned maxClique{colors + colors / 4};
+  std::vector<std::vector<unsigned>> cliques(nodes);
+  Edges edges;
+  for (unsigned node{1}; node < nodes; ++node) {
+    unsigned parent{std::uniform_int_distribution<unsigned>(0, node - 1)(rng)};
+    std::vector<unsigned> candidates = cliques[parent];
+    candidates.push_back(parent);
+    std::shuffle(candidates.begin(), candidates.end(), rng);
+    unsigned count{std::uniform_int_distribution<unsigned>(
+        1, std::min<unsigned>(candidates.size(), maxClique - 1))(rng)};
+    candidates.resize(count);
+    for (unsigned neighbour : candidates) {
+      edges.emplace_back(neighbour, node);
+    }
+    cliques[node] = std::move(candidates);
+  }
+  return edges;
+}
+
+auto createGraph(unsigned nodes, unsigned colors, const Edges &edges,
+                 std::mt19937 &rng) -> alihan::InterferenceGraph {
+  std::uniform_real_distribution<double> weightDist(1.0, 100.0);
+  std::uniform_int_distribution<unsigned> nodeDist(0, nodes - 1);
+  std::uniform_int_distribution<unsigned> colorDist(0, colors - 1);
+
+  alihan::InterferenceGraph graph(colors);
+  for (unsigned node{0}; node != nodes; ++node) {
+    graph.addNode(node, weightDist(rng), true);
+  }
+  for (auto [node1, node2] : edges) {
+    graph.addEdge(node1, node2);
+  }
+  // Stand-ins for live physical registers and copies.
+  for (unsigned i{0}; i != nodes / 8; ++i) {
+    graph.forbidColor(nodeDist(rng), colorDist(rng));
+  }
+  for (unsigned i{0}; i != nodes / 4; ++i) {
+    unsigned node1{nodeDist(rng)};
+    unsigned node2{nodeDist(rng)};
+    if (node1 != node2 && !graph.hasEdge(node1, node2)) {
+      graph.addMove(node1, node2, weightDist(rng));
+    }
+  }
+  return graph;
+}
+
+struct Result {
+  double milliseconds;
+  std::size_t peakBytes;
+  std::size_t colorsUsed;
+  double spillCost;
+  // Weight of the moves whose ends got different colors.
+  double moveCost;
+};
+
+auto evaluate(const alihan::InterferenceGraph &graph,
+              const alihan::SolutionMap &solution, Result &result) -> bool {
+  std::set<unsigned> colors;
+  result.spillCost = 0.0;
+  result.moveCost = 0.0;
+  for (unsigned node : graph.getNodeRange()) {
+    unsigned color{solution[node]};
+    if (color == alihan::NoColor) {
+      result.spillCost += graph.getWeight(node).value();
+      continue;
+    }
+    if (graph.isColorForbidden(node, color)) {
+      return false;
+    }
+    colors.insert(color);
+    for (unsigned neighbour : graph.getEdgeRange(node)) {
+      if (solution[neighbour] == color) {
+        return false;
+      }
+    }
+    for (const alihan::InterferenceGraph::Move &move :
+         graph.getMoveRange(node)) {
+      if (node < move.node && solution[move.node] != color) {
+        result.moveCost += move.weight;
+      }
+    }
+  }
+  result.colorsUsed = colors.size();
+  return true;
+}
+
+using Solver = alihan::SolutionMap (*)(const alihan::InterferenceGraph &,
+                                       std::size_t, alihan::SolverStats &);
+
+auto measure(Solver solver, const alihan::InterferenceGraph &graph,
+             std::size_t colors, Result &result) -> bool {
+  alihan::SolverStats stats;
+  std::size_t baseBytes{currentBytes};
+  peakBytes = currentBytes;
+  auto start = std::chrono::steady_clock::now();
+  alihan::SolutionMap solution = solver(graph, colors, stats);
+  std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - start};
+  result.milliseconds = elapsed.count();
+  result.peakBytes = peakBytes - baseBytes;
+  return evaluate(graph, solution, result);
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  unsigned nodes{argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10))
+                          : 2000u};
+  unsigned colors{argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10))
+                           : 16u};
+  std::mt19937 rng(argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1);
+  if (nodes < 2 || colors < 2) {
+    std::cerr << "need at least 2 nodes and 2 colors\n";
+    return 1;
+  }
+
+  const std::pair<const char *, Edges (*)(unsigned, unsigned, std::mt19937 &)>
+      generators[]{{"random", generateRandom},
+                   {"interval", generateInterval},
+                   {"chordal", generateChordal}};
+  const std::pair<const char *, Solver> solvers[]{
+      {"greedy", alihan::solveGreedy},
+      {"chaitin", alihan::solveChaitin},
+      {"optimistic", alihan::solveOptimistic},
+      {"coalescing", alihan::solveCoalescing}};
+
+  std::cout << "graph\tnodes\tedges\tcolors\tsolver\tms\tpeak KiB\tcolors used"
+               "\tspill cost\tmove cost\n";
+  for (auto [graphName, generate] : generators) {
+    Edges edges = generate(nodes, colors, rng);
+    alihan::InterferenceGraph graph = createGraph(nodes, colors, edges, rng);
+    for (auto [solverName, solver] : solvers) {
+      Result result;
+      if (!measure(solver, graph, colors, result)) {
+        std::cerr << solverName << " returned an invalid coloring for the "
+                  << graphName << " graph\n";
+        return 1;
+      }
+      std::cout << graphName << '\t' << nodes << '\t' << edges.size() << '\t'
+                << colors << '\t' << solverName << '\t' << result.milliseconds
+                << '\t' << result.peakBytes / 1024 << '\t' << result.colorsUsed
+                << '\t' << result.spillCost << '\t' << result.moveCost << '\n';
+    }
+  }
+  return 0;
+}
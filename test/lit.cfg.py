@@ -0,0 +1,21 @@
+# Regression tests for the Chaitin register allocator plugin. The build
+# generates lit.site.cfg.py, which points at the plugin and at the llc and
+# FileCheck of the LLVM it was built against, and then loads this file.
+
+import os
+
+import lit.formats
+
+config.name = "Chaitin"
+config.test_format = lit.formats.ShTest()
+config.suffixes = [".ll", ".mir"]
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = config.chaitin_obj_root
+
+config.environment["PATH"] = os.path.pathsep.join(
+    [config.llvm_tools_dir, config.environment.get("PATH", "")]
+)
+config.substitutions.append(("%chaitin", config.chaitin_plugin))
+
+for target in config.llvm_targets_to_build:
+    config.available_features.add(target.lower() + "-registered-target")